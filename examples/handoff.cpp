@@ -0,0 +1,71 @@
+#include <zth>
+#include <cstdio>
+
+// A client and server play ping-pong via a zth::ConditionVariable.
+// With a zth::Synchronizer::Handoff mode set on the mutex, unlocking it switches
+// immediately to the fiber that was woken up, instead of letting it wait till the
+// other fibers (the busy ones below) had their turn.
+
+static int const Rounds = 1000;
+
+static zth::Mutex mutex("mutex");
+static zth::ConditionVariable cv("cv");
+static int ball;
+static bool stop;
+
+void server() {
+	mutex.lock();
+	while(ball < 2 * Rounds) {
+		while(ball % 2 == 0 && ball < 2 * Rounds)
+			cv.wait(mutex);
+		if(ball < 2 * Rounds) {
+			ball++;
+			cv.notifyOne();
+		}
+	}
+	mutex.unlock();
+}
+zth_fiber(server)
+
+void busy() {
+	while(!stop) {
+		zth::Timestamp t = zth::Timestamp::now() + zth::TimeInterval(20e-6);
+		while(zth::Timestamp::now() < t);
+		zth::yield();
+	}
+}
+zth_fiber(busy)
+
+static void play(zth::Synchronizer::Handoff handoff, char const* name) {
+	mutex.setHandoff(handoff);
+	ball = 0;
+	server_future s = async server();
+
+	zth::Timestamp t0 = zth::Timestamp::now();
+	mutex.lock();
+	for(int i = 0; i < Rounds; i++) {
+		ball++;
+		cv.notifyOne();
+		while(ball % 2 == 1)
+			cv.wait(mutex);
+	}
+	mutex.unlock();
+	zth::TimeInterval dt = zth::Timestamp::now() - t0;
+
+	s->wait();
+	printf("%-13s %s per round trip\n", name, (dt / Rounds).str().c_str());
+}
+
+void main_fiber(int argc, char** argv) {
+	busy_future b[4];
+	for(size_t i = 0; i < sizeof(b) / sizeof(b[0]); i++)
+		b[i] = async busy();
+
+	play(zth::Synchronizer::NoHandoff, "NoHandoff");
+	play(zth::Synchronizer::SwitchOnWake, "SwitchOnWake");
+	play(zth::Synchronizer::DonateOnWake, "DonateOnWake");
+
+	stop = true;
+	for(size_t i = 0; i < sizeof(b) / sizeof(b[0]); i++)
+		b[i]->wait();
+}
@@ -0,0 +1,324 @@
+/*
+ * Zth (libzth), a cooperative userspace multitasking library.
+ * Copyright (C) 2019  Jochem Rutgers
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * libzth-hook interposes libc calls that would block the Worker, when
+ * they are called from within a fiber. Other calls are passed to libc.
+ *
+ * The hooks cannot just call zth::io, as that calls the same libc
+ * functions again. Therefore, they only wait for the fd in the Waiter, and
+ * leave the actual call to the libc version, which is looked up using
+ * dlsym(RTLD_NEXT).
+ */
+
+#define ZTH_REDIRECT_IO 0
+
+// With ZeroMQ, <zth> redefines the POLL* flags to the ZMQ_POLL* ones of
+// zth_pollfd_t. Save the libc flags, which the hooked poll() and real_poll() use.
+#include <poll.h>
+enum {
+	LibcPollIn = POLLIN,
+	LibcPollPri = POLLPRI,
+	LibcPollOut = POLLOUT,
+	LibcPollErr = POLLERR,
+	LibcPollRdNorm = POLLRDNORM,
+	LibcPollWrNorm = POLLWRNORM
+};
+
+#include <zth>
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#define ZTH_HOOK_REAL(name) \
+	static decltype(&::name) real_##name = NULL; \
+	if(unlikely(!real_##name)) \
+		real_##name = (decltype(&::name))dlsym(RTLD_NEXT, #name);
+
+/*!
+ * \brief Checks if the current call can be handed off to zth.
+ * \details This is not the case outside fibers, and within the Waiter, which does the actual polling.
+ */
+static bool hookable() {
+	zth::Worker* worker = zth::Worker::currentWorker();
+	if(!worker || !worker->contextSwitchEnabled())
+		return false;
+
+	zth::Fiber* fiber = worker->currentFiber();
+	return fiber && fiber != worker->waiter().fiber();
+}
+
+/*!
+ * \brief Checks if the given fd is in blocking mode.
+ */
+static bool blocking(int fd) {
+	int flags = fcntl(fd, F_GETFL);
+	return flags != -1 && !(flags & O_NONBLOCK);
+}
+
+#ifdef ZTH_HAVE_LIBZMQ
+/*!
+ * \brief Converts libc \c POLL* flags to the ones of #zth_pollfd_t.
+ */
+static short toZth(short events) {
+	short res = 0;
+	if(events & (LibcPollIn | LibcPollRdNorm))
+		res |= POLLIN;
+	if(events & (LibcPollOut | LibcPollWrNorm))
+		res |= POLLOUT;
+	if(events & LibcPollPri)
+		res |= POLLPRI;
+	if(events & LibcPollErr)
+		res |= POLLERR;
+	return res;
+}
+#endif
+
+/*!
+ * \brief Converts the \c POLL* flags of #zth_pollfd_t to the libc ones.
+ */
+static short fromZth(short events) {
+#ifdef ZTH_HAVE_LIBZMQ
+	short res = 0;
+	if(events & POLLIN)
+		res |= LibcPollIn;
+	if(events & POLLOUT)
+		res |= LibcPollOut;
+	if(events & POLLPRI)
+		res |= LibcPollPri;
+	if(events & POLLERR)
+		res |= LibcPollErr;
+	return res;
+#else
+	return events;
+#endif
+}
+
+/*!
+ * \brief Wait till the given fd is ready, while other fibers continue.
+ * \param events the \c POLL* flags of #zth_pollfd_t
+ * \return 0 on success, otherwise an \c errno
+ */
+static int await(int fd, short events) {
+	ZTH_HOOK_REAL(poll)
+
+	struct pollfd p = {};
+	p.fd = fd;
+	p.events = fromZth(events);
+	if(real_poll(&p, 1, 0) != 0)
+		// Ready, or some error, which is reported by the actual call.
+		return 0;
+
+	zth::Await1Fd w(fd, events);
+	return zth::currentWorker().waiter().waitFd(w);
+}
+
+EXTERN_C ZTH_EXPORT ssize_t read(int fd, void* buf, size_t count) {
+	ZTH_HOOK_REAL(read)
+
+	if(hookable() && blocking(fd)) {
+		zth::perf_syscall("read()");
+		if(int error = await(fd, POLLIN)) {
+			errno = error;
+			return -1;
+		}
+	}
+
+	return real_read(fd, buf, count);
+}
+
+/*!
+ * \brief Writes in parts, while waiting for room in between.
+ * \details For a socket, \c MSG_DONTWAIT is used. Otherwise, the fd must be non-blocking already.
+ */
+static ssize_t writeParts(int fd, char const* p, size_t count, bool socket) {
+	ZTH_HOOK_REAL(write)
+
+	size_t done = 0;
+
+	while(true) {
+		ssize_t res = socket
+			? send(fd, p + done, count - done, MSG_DONTWAIT)
+			: real_write(fd, p + done, count - done);
+		if(res == -1) {
+			if(errno != EAGAIN && errno != EWOULDBLOCK)
+				return done ? (ssize_t)done : -1;
+		} else if((done += (size_t)res) == count || res == 0) {
+			return (ssize_t)done;
+		} else {
+			continue;
+		}
+
+		if(socket && !blocking(fd)) {
+			if(done)
+				return (ssize_t)done;
+			errno = EAGAIN;
+			return -1;
+		}
+
+		if(int error = await(fd, POLLOUT)) {
+			if(done)
+				return (ssize_t)done;
+			errno = error;
+			return -1;
+		}
+	}
+}
+
+EXTERN_C ZTH_EXPORT ssize_t write(int fd, void const* buf, size_t count) {
+	ZTH_HOOK_REAL(write)
+	ZTH_HOOK_REAL(poll)
+
+	// Only pipes and sockets are handed off, as poll() does not tell whether
+	// writing to other fds, like regular files and ttys, would block.
+	struct stat st;
+	if(!hookable() || fstat(fd, &st) == -1 || !(S_ISFIFO(st.st_mode) || S_ISSOCK(st.st_mode)))
+		return real_write(fd, buf, count);
+
+	zth::perf_syscall("write()");
+
+	char const* p = static_cast<char const*>(buf);
+
+	if(S_ISSOCK(st.st_mode))
+		return writeParts(fd, p, count, true);
+
+	if(!blocking(fd))
+		return real_write(fd, buf, count);
+
+	if(count <= PIPE_BUF) {
+		struct pollfd pfd = {};
+		pfd.fd = fd;
+		pfd.events = LibcPollOut;
+		if(real_poll(&pfd, 1, 0) == 1)
+			// A pipe with room takes PIPE_BUF bytes without blocking.
+			return real_write(fd, buf, count);
+	}
+
+	// POLLOUT does not guarantee that all data fits, so write in parts without blocking.
+	// Note that this also affects duplicates of the fd in other processes.
+	zth::io::NonBlocking nb(fd);
+	return writeParts(fd, p, count, false);
+}
+
+EXTERN_C ZTH_EXPORT int connect(int sockfd, struct sockaddr const* addr, socklen_t addrlen) {
+	ZTH_HOOK_REAL(connect)
+
+	if(!hookable() || !blocking(sockfd))
+		return real_connect(sockfd, addr, addrlen);
+
+	zth::perf_syscall("connect()");
+
+	// Do a non-blocking connect, and wait for it to complete.
+	int flags = fcntl(sockfd, F_GETFL);
+	if(fcntl(sockfd, F_SETFL, flags | O_NONBLOCK) == -1)
+		return real_connect(sockfd, addr, addrlen);
+
+	int res = real_connect(sockfd, addr, addrlen);
+	int error = res == -1 ? errno : 0;
+
+	if(error == EINPROGRESS && !(error = await(sockfd, POLLOUT))) {
+		socklen_t len = sizeof(error);
+		if(getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &error, &len))
+			error = errno;
+	}
+
+	fcntl(sockfd, F_SETFL, flags);
+
+	if(error) {
+		errno = error;
+		return -1;
+	}
+	return 0;
+}
+
+EXTERN_C ZTH_EXPORT int poll(struct pollfd* fds, nfds_t nfds, int timeout) {
+	ZTH_HOOK_REAL(poll)
+
+	if(timeout == 0 || !hookable())
+		return real_poll(fds, nfds, timeout);
+
+	zth::perf_syscall("poll()");
+
+	zth::Timestamp t;
+	if(timeout > 0)
+		t = zth::Timestamp::now() + zth::TimeInterval(timeout / 1000, (long)(timeout % 1000) * 1000000L);
+
+	if(nfds == 0) {
+		// Just a sleep, as the Waiter cannot wait for an empty set of fds.
+		if(timeout < 0)
+			// Like the real poll() without a signal handler, never return.
+			while(true)
+				zth::suspend();
+		zth::nap(t);
+		return 0;
+	}
+
+	int res = real_poll(fds, nfds, 0);
+	if(res != 0)
+		return res;
+
+#ifdef ZTH_HAVE_LIBZMQ
+	// The Waiter uses zmq_poll(), which has its own struct.
+	std::vector<zth_pollfd_t> items(nfds);
+	for(nfds_t i = 0; i < nfds; i++) {
+		items[i].fd = fds[i].fd;
+		items[i].events = toZth(fds[i].events);
+	}
+	zth::AwaitFd w(&items[0], (int)nfds, t);
+#else
+	zth::AwaitFd w(fds, (int)nfds, t);
+#endif
+
+	if(int error = zth::currentWorker().waiter().waitFd(w)) {
+		errno = error;
+		return -1;
+	}
+
+#ifdef ZTH_HAVE_LIBZMQ
+	for(nfds_t i = 0; i < nfds; i++)
+		fds[i].revents = fromZth(items[i].revents);
+#endif
+
+	return w.result();
+}
+
+EXTERN_C ZTH_EXPORT unsigned int sleep(unsigned int seconds) {
+	ZTH_HOOK_REAL(sleep)
+
+	if(!hookable())
+		return real_sleep(seconds);
+
+	zth::nap(zth::TimeInterval((time_t)seconds));
+	return 0;
+}
+
+EXTERN_C ZTH_EXPORT int usleep(useconds_t usec) {
+	ZTH_HOOK_REAL(usleep)
+
+	if(!hookable())
+		return real_usleep(usec);
+
+	zth::unap((long)usec);
+	return 0;
+}
@@ -201,7 +201,9 @@ namespace zth {
 		template <typename F>
 		AutoFuture& operator=(TypedFiber<T,F>* fiber) {
 			if(fiber) {
-				this->reset(new Future_type(format("Future of %s", fiber->name().c_str()).c_str()));
+				this->reset(Config::NamedSynchronizer
+					? new Future_type(format("Future of %s", fiber->name().c_str()).c_str())
+					: new Future_type());
 				fiber->registerFuture(this->get());
 			} else {
 				this->reset();
@@ -0,0 +1,155 @@
+#ifndef __ZTH_BLOCKING_H
+#define __ZTH_BLOCKING_H
+/*
+ * Zth (libzth), a cooperative userspace multitasking library.
+ * Copyright (C) 2019  Jochem Rutgers
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <libzth/macros.h>
+#include <libzth/config.h>
+
+/*!
+ * \brief Call the function \p f with \p arg in a helper thread, while other fibers continue.
+ * \details Use this for calls that may block, but cannot be polled, such as \c read() on a regular file,
+ *          \c fsync(), \c stat() and \c getaddrinfo().
+ *          The \c errno, as left by \p f, is passed back to the caller.
+ *          When there are no helper threads, or when not called from a fiber, \p f is just called directly.
+ * \param f the function with prototype \c void*(void*) to be called
+ * \param arg the argument to pass to \p f
+ * \return the return value of \p f
+ * \ingroup zth_api_c_fiber
+ */
+EXTERN_C ZTH_EXPORT void* zth_blocking(void*(*f)(void*), void* arg);
+
+#ifdef __cplusplus
+#include <libzth/context.h>
+
+namespace zth {
+
+	/*!
+	 * \copydoc zth::blocking(void(*)())
+	 */
+	template <typename R>
+	inline R blocking(R(*f)())
+	{
+		impl::FunctionIO0<R> f_ = {{f}};
+		return *(R*)zth_blocking((void*(*)(void*))&impl::stack_switch_fwd<decltype(f_)>, &f_);
+	}
+
+	/*!
+	 * \brief \copybrief zth_blocking()
+	 * \details Type-safe C++ wrapper for #zth_blocking().
+	 * \ingroup zth_api_cpp_fiber
+	 */
+	inline void blocking(void(*f)())
+	{
+		impl::FunctionIO0<void> f_ = {{f}};
+		zth_blocking((void*(*)(void*))&impl::stack_switch_fwd<decltype(f_)>, &f_);
+	}
+
+	/*!
+	 * \copydoc zth::blocking(void(*)())
+	 * \ingroup zth_api_cpp_fiber
+	 */
+	template <typename R, typename A1>
+	inline R blocking(R(*f)(A1), A1 a1)
+	{
+		impl::FunctionIO1<R,A1> f_ = {{f, a1}};
+		return *(R*)zth_blocking((void*(*)(void*))&impl::stack_switch_fwd<decltype(f_)>, &f_);
+	}
+
+	/*!
+	 * \copydoc zth::blocking(void(*)())
+	 * \ingroup zth_api_cpp_fiber
+	 */
+	template <typename A1>
+	inline void blocking(void(*f)(A1), A1 a1)
+	{
+		impl::FunctionIO1<void,A1> f_ = {{f, a1}};
+		zth_blocking((void*(*)(void*))&impl::stack_switch_fwd<decltype(f_)>, &f_);
+	}
+
+	/*!
+	 * \copydoc zth::blocking(void(*)())
+	 * \ingroup zth_api_cpp_fiber
+	 */
+	template <typename R, typename A1, typename A2>
+	inline R blocking(R(*f)(A1,A2), A1 a1, A2 a2)
+	{
+		impl::FunctionIO2<R,A1,A2> f_ = {{f, a1, a2}};
+		return *(R*)zth_blocking((void*(*)(void*))&impl::stack_switch_fwd<decltype(f_)>, &f_);
+	}
+
+	/*!
+	 * \copydoc zth::blocking(void(*)())
+	 * \ingroup zth_api_cpp_fiber
+	 */
+	template <typename A1, typename A2>
+	inline void blocking(void(*f)(A1,A2), A1 a1, A2 a2)
+	{
+		impl::FunctionIO2<void,A1,A2> f_ = {{f, a1, a2}};
+		zth_blocking((void*(*)(void*))&impl::stack_switch_fwd<decltype(f_)>, &f_);
+	}
+
+	/*!
+	 * \copydoc zth::blocking(void(*)())
+	 * \ingroup zth_api_cpp_fiber
+	 */
+	template <typename R, typename A1, typename A2, typename A3>
+	inline R blocking(R(*f)(A1,A2,A3), A1 a1, A2 a2, A3 a3)
+	{
+		impl::FunctionIO3<R,A1,A2,A3> f_ = {{f, a1, a2, a3}};
+		return *(R*)zth_blocking((void*(*)(void*))&impl::stack_switch_fwd<decltype(f_)>, &f_);
+	}
+
+	/*!
+	 * \copydoc zth::blocking(void(*)())
+	 * \ingroup zth_api_cpp_fiber
+	 */
+	template <typename A1, typename A2, typename A3>
+	inline void blocking(void(*f)(A1,A2,A3), A1 a1, A2 a2, A3 a3)
+	{
+		impl::FunctionIO3<void,A1,A2,A3> f_ = {{f, a1, a2, a3}};
+		zth_blocking((void*(*)(void*))&impl::stack_switch_fwd<decltype(f_)>, &f_);
+	}
+
+#  if __cplusplus >= 201103L
+	/*!
+	 * \copydoc zth::blocking(void(*)())
+	 * \ingroup zth_api_cpp_fiber
+	 */
+	template <typename R, typename A1, typename A2, typename A3, typename... A>
+	inline typename std::enable_if<!std::is_void<R>::value,R>::type blocking(R(*f)(A1,A2,A3,A...), A1 a1, A2 a2, A3 a3, A... a)
+	{
+		impl::FunctionION<R,A1,A2,A3,A...> f_ = {{f, {a1, a2, a3, a...}}};
+		return *(R*)zth_blocking((void*(*)(void*))&impl::stack_switch_fwd<decltype(f_)>, &f_);
+	}
+
+	/*!
+	 * \copydoc zth::blocking(void(*)())
+	 * \ingroup zth_api_cpp_fiber
+	 */
+	template <typename A1, typename A2, typename A3, typename... A>
+	inline void blocking(void(*f)(A1,A2,A3,A...), A1 a1, A2 a2, A3 a3, A... a)
+	{
+		impl::FunctionION<void,A1,A2,A3,A...> f_ = {{f, {a1, a2, a3, a...}}};
+		zth_blocking((void*(*)(void*))&impl::stack_switch_fwd<decltype(f_)>, &f_);
+	}
+#  endif
+} // namespace
+
+#endif // __cplusplus
+#endif // __ZTH_BLOCKING_H
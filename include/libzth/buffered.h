@@ -0,0 +1,145 @@
+#ifndef __ZTH_BUFFERED_H
+#define __ZTH_BUFFERED_H
+/*
+ * Zth (libzth), a cooperative userspace multitasking library.
+ * Copyright (C) 2019  Jochem Rutgers
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <libzth/macros.h>
+#include <libzth/io.h>
+
+#if defined(__cplusplus) && defined(ZTH_HAVE_POLLER) && !defined(ZTH_OS_WINDOWS)
+#include <libzth/time.h>
+#include <libzth/waiter.h>
+
+#include <string>
+#include <sys/uio.h>
+
+namespace zth { namespace io {
+
+	/*!
+	 * \brief A fixed-size ring buffer, as used by zth::io::BufferedReader and zth::io::BufferedWriter.
+	 * \ingroup zth_api_cpp_io
+	 */
+	class ZTH_EXPORT RingBuffer {
+	public:
+		explicit RingBuffer(size_t size);
+		~RingBuffer();
+
+		size_t size() const { return m_size; }
+		size_t used() const { return m_used; }
+		size_t space() const { return m_size - m_used; }
+		bool empty() const { return m_used == 0; }
+		bool full() const { return m_used == m_size; }
+
+		int dataSegments(struct iovec* iov) const;
+		int spaceSegments(struct iovec* iov);
+		void produced(size_t count);
+		void consumed(size_t count);
+
+		size_t peek(void* buf, size_t count) const;
+		size_t get(void* buf, size_t count);
+		size_t put(void const* buf, size_t count);
+		size_t find(char c, size_t offset = 0) const;
+	private:
+		RingBuffer(RingBuffer const&);
+		RingBuffer& operator=(RingBuffer const&);
+
+		char* m_buffer;
+		size_t m_size;
+		size_t m_head;
+		size_t m_used;
+	};
+
+	/*!
+	 * \brief Reads from an fd via a buffer, such that multiple messages are read with only one syscall.
+	 * \details When the buffer is empty, the fiber waits for the fd via the zth::Waiter.
+	 *          Do not use a reader from multiple fibers concurrently.
+	 * \ingroup zth_api_cpp_io
+	 */
+	class ZTH_EXPORT BufferedReader {
+	public:
+		explicit BufferedReader(int fd, size_t size = 0x1000);
+
+		int fd() const { return m_fd; }
+		size_t available() const { return m_buffer.used(); }
+
+		ssize_t fill();
+		// Forward to read_(), as read() may be redirected to zth_read() by a macro.
+		ssize_t read(void* buf, size_t count) { return read_(buf, count); }
+		ssize_t readExact(void* buf, size_t count);
+		ssize_t readLine(std::string& line, char delim = '\n', size_t maxLength = 0);
+		ssize_t readFrame(std::string& frame, size_t maxLength = 0);
+	protected:
+		ssize_t read_(void* buf, size_t count);
+	private:
+		BufferedReader(BufferedReader const&);
+		BufferedReader& operator=(BufferedReader const&);
+
+		int m_fd;
+		RingBuffer m_buffer;
+	};
+
+	/*!
+	 * \brief Writes to an fd via a buffer, such that multiple small writes are combined in one \c writev().
+	 * \details The buffer is flushed when it is full, by #flush(), or by the zth::Waiter when the flush delay
+	 *          has passed since the first unflushed write. With a delay of 0, the data is flushed as soon as
+	 *          the Waiter runs, so all writes between two context switches are combined.
+	 *          When the fd cannot keep up, writing fibers wait via the Waiter.
+	 *          Do not use a writer from multiple fibers concurrently.
+	 * \ingroup zth_api_cpp_io
+	 */
+	class ZTH_EXPORT BufferedWriter {
+	public:
+		explicit BufferedWriter(int fd, size_t size = 0x1000, TimeInterval const& flushDelay = TimeInterval());
+		~BufferedWriter();
+
+		int fd() const { return m_fd; }
+		size_t pending() const { return m_buffer.used(); }
+		TimeInterval const& flushDelay() const { return m_flushDelay; }
+		void setFlushDelay(TimeInterval const& delay) { m_flushDelay = delay; }
+
+		ssize_t write(void const* buf, size_t count);
+		ssize_t writeFrame(void const* buf, size_t count);
+		int flush();
+	protected:
+		ssize_t writev(void const* extra, size_t extraCount, bool block);
+		bool flushTask(Timestamp const& now);
+	private:
+		BufferedWriter(BufferedWriter const&);
+		BufferedWriter& operator=(BufferedWriter const&);
+
+		class FlushTask : public TimedWaitable {
+		public:
+			explicit FlushTask(BufferedWriter& writer) : TimedWaitable(Timestamp()), m_writer(writer) {}
+			virtual ~FlushTask() {}
+			virtual bool poll(Timestamp const& now = Timestamp::now());
+			using TimedWaitable::setTimeout;
+		private:
+			BufferedWriter& m_writer;
+		};
+
+		int m_fd;
+		RingBuffer m_buffer;
+		TimeInterval m_flushDelay;
+		FlushTask m_flushTask;
+		bool m_scheduled;
+		bool m_flushing;
+	};
+
+} } // namespace
+#endif // __cplusplus && ZTH_HAVE_POLLER && !ZTH_OS_WINDOWS
+#endif // __ZTH_BUFFERED_H
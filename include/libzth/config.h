@@ -91,6 +91,12 @@ namespace zth {
 		static bool const EnableStackWaterMark = Debug;
 		static bool const ContextSignals = false;
 		constexpr static double MinTimeslice_s() { return 1e-4; }
+		// Busy-wait this long before a timer expires, instead of letting the OS wake us up (which may be late).
+		constexpr static double TimerSpin_s() { return 0; }
+		// When false, the Worker checks timers and fds itself from schedule(), instead of via a separate zth::Waiter fiber.
+		static bool const EnableWaiterFiber = true;
+		// Maximum number of helper threads that execute zth::blocking() calls.
+		static size_t const BlockingThreads = 4;
 		static int const TimesliceOverrunFactorReportThreshold = 4;
 		static bool const CheckTimesliceOverrun = Debug;
 		static bool const NamedSynchronizer = EnableDebugPrint && Print_sync > 0;
@@ -112,6 +112,12 @@ namespace zth {
 		Timestamp const& runningSince() const { return m_startRun; }
 		Timestamp const& stateEnd() const { return m_stateEnd; }
 		TimeInterval const& totalTime() const { return m_totalTime; }
+
+		/*!
+		 * \brief Lets the next timeslice of this fiber last at least till \p end.
+		 * \details This is used to hand over the rest of the timeslice of the current fiber.
+		 */
+		void donateTimeslice(Timestamp const& end) { m_donatedEnd = end; }
 		void addCleanup(void(*f)(Fiber&,void*), void* arg) { m_cleanup.push_back(std::make_pair(f, arg)); }
 
 		int init(Timestamp const& now = Timestamp::now()) {
@@ -168,6 +174,9 @@ namespace zth {
 					m_startRun = now;
 					setState(Running, now);
 					m_stateEnd = now + m_timeslice;
+					if(unlikely(m_donatedEnd.isAfter(m_stateEnd)))
+						m_stateEnd = m_donatedEnd;
+					m_donatedEnd = Timestamp::null();
 
 					zth_dbg(fiber, "Switch from %s to %s after %s", from.id_str(), id_str(), dt.str().c_str());
 					context_switch(from.context(), context());
@@ -346,6 +355,7 @@ namespace zth {
 		TimeInterval m_totalTime;
 		Timestamp m_startRun;
 		Timestamp m_stateEnd;
+		Timestamp m_donatedEnd;
 		TimeInterval m_timeslice;
 		TimeInterval m_dtMax;
 		std::list<std::pair<void(*)(Fiber&,void*),void*> > m_cleanup;
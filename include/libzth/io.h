@@ -30,6 +30,14 @@
 #include <libzth/macros.h>
 #include <unistd.h>
 
+#ifndef ZTH_OS_WINDOWS
+#  include <fcntl.h>
+#endif
+#ifdef ZTH_OS_LINUX
+#  include <sys/types.h>
+#  include <sys/uio.h>
+#endif
+
 #if defined(ZTH_HAVE_POLL) || defined(ZTH_HAVE_LIBZMQ)
 #  define ZTH_HAVE_POLLER
 #endif
@@ -47,6 +55,9 @@
 #  ifdef ZTH_HAVE_POLL
 #    include <poll.h>
 #  endif
+#  ifndef ZTH_OS_WINDOWS
+#    include <sys/socket.h>
+#  endif
 
 #  ifdef ZTH_HAVE_LIBZMQ
 #    include <zmq.h>
@@ -60,11 +71,168 @@
 #  endif
 
 #  if defined(__cplusplus) && !defined(ZTH_OS_WINDOWS)
+#    include <map>
+#    include <vector>
+#    ifdef ZTH_HAVE_EPOLL
+#      include <sys/epoll.h>
+#    endif
+
 namespace zth { namespace io {
 
 	ZTH_EXPORT ssize_t read(int fd, void* buf, size_t count);
+	ZTH_EXPORT ssize_t write(int fd, void const* buf, size_t count);
+	ZTH_EXPORT int connect(int sockfd, struct sockaddr const* addr, socklen_t addrlen);
 	ZTH_EXPORT int select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, struct timeval *timeout);
 	ZTH_EXPORT int poll(zth_pollfd_t *fds, int nfds, int timeout);
+
+	/*!
+	 * \brief Sets \c O_NONBLOCK on an fd during the lifetime of this object, when it was not set already.
+	 * \details Note that this flag is shared by all duplicates of the fd, also the ones in other processes.
+	 * \ingroup zth_api_cpp_io
+	 */
+	class NonBlocking {
+	public:
+		explicit NonBlocking(int fd)
+			: m_fd(fd)
+			, m_flags(fcntl(fd, F_GETFL))
+		{
+			if(m_flags == -1 || (m_flags & O_NONBLOCK) || fcntl(fd, F_SETFL, m_flags | O_NONBLOCK) == -1)
+				m_flags = -1;
+		}
+
+		~NonBlocking() {
+			if(m_flags != -1)
+				fcntl(m_fd, F_SETFL, m_flags);
+		}
+
+		bool changed() const { return m_flags != -1; }
+	private:
+		NonBlocking(NonBlocking const&);
+		NonBlocking& operator=(NonBlocking const&);
+
+		int m_fd;
+		int m_flags;
+	};
+
+	/*!
+	 * \brief A set of fds, which is registered once, and can then be waited for repeatedly.
+	 * \details On Linux, this is backed by epoll, such that only one fd is passed to the zth::Waiter,
+	 *          regardless of the number of fds in the set. Otherwise, a persistent \c pollfd array is used.
+	 * \ingroup zth_api_cpp_io
+	 */
+	class ZTH_EXPORT PollSet {
+	public:
+		/*!
+		 * \brief An fd that got ready, as returned by #wait().
+		 */
+		struct Event {
+			int fd;
+			short revents;
+			void* user;
+		};
+
+		PollSet();
+		~PollSet();
+
+		int add(int fd, short events, void* user = NULL);
+		int modify(int fd, short events, void* user = NULL);
+		int remove(int fd);
+		size_t size() const;
+
+		int wait(int timeout = -1);
+		size_t readyCount() const { return m_ready.size(); }
+		Event const& ready(size_t i) const { return m_ready[i]; }
+	private:
+		PollSet(PollSet const&);
+		PollSet& operator=(PollSet const&);
+
+		int collect();
+
+#    ifdef ZTH_HAVE_EPOLL
+		struct Entry {
+			int fd;
+			void* user;
+		};
+
+		int m_epfd;
+		std::map<int,Entry> m_entries;
+		std::vector<struct epoll_event> m_events;
+#    else
+		std::vector<zth_pollfd_t> m_fds;
+		std::vector<void*> m_user;
+#    endif
+		std::vector<Event> m_ready;
+	};
+
+#    ifdef ZTH_OS_LINUX
+	ZTH_EXPORT ssize_t sendfile(int out_fd, int in_fd, off_t* offset, size_t count);
+	ZTH_EXPORT ssize_t splice(int fd_in, loff_t* off_in, int fd_out, loff_t* off_out, size_t len, unsigned int flags = 0);
+	ZTH_EXPORT ssize_t tee(int fd_in, int fd_out, size_t len, unsigned int flags = 0);
+
+	/*!
+	 * \brief A pipe to zth::io::splice() data between two fds that are not pipes, such as two sockets.
+	 * \details Data that was read from the input, but could not be written to the output yet,
+	 *          stays in the pipe, and is written first by the next #transfer().
+	 * \ingroup zth_api_cpp_io
+	 */
+	class ZTH_EXPORT SplicePipe {
+	public:
+		SplicePipe() : m_pending() { m_fd[0] = m_fd[1] = -1; }
+		~SplicePipe();
+
+		ssize_t transfer(int fd_in, int fd_out, size_t len);
+		size_t pending() const { return m_pending; }
+	private:
+		SplicePipe(SplicePipe const&);
+		SplicePipe& operator=(SplicePipe const&);
+
+		int m_fd[2];
+		size_t m_pending;
+	};
+
+	ZTH_EXPORT int recvmmsg(int sockfd, struct mmsghdr* msgvec, unsigned int vlen, int flags = 0);
+	ZTH_EXPORT int sendmmsg(int sockfd, struct mmsghdr* msgvec, unsigned int vlen, int flags = 0);
+
+	/*!
+	 * \brief A reusable set of datagram buffers, to receive or send multiple datagrams with one syscall.
+	 * \details Either use it to receive, via #recv(), or to send, by #add()ing messages and calling #send().
+	 * \ingroup zth_api_cpp_io
+	 */
+	class ZTH_EXPORT MessageBatch {
+	public:
+		MessageBatch(size_t capacity, size_t messageSize);
+		~MessageBatch();
+
+		size_t capacity() const { return m_capacity; }
+		size_t messageSize() const { return m_messageSize; }
+		size_t size() const { return m_size; }
+		bool empty() const { return m_size == m_sent; }
+		bool full() const { return m_size == m_capacity; }
+		void clear() { m_size = m_sent = 0; }
+
+		void* data(size_t i) const { return m_iov[i].iov_base; }
+		size_t length(size_t i) const { return i < m_size ? m_msg[i].msg_len : 0; }
+		bool truncated(size_t i) const { return i < m_size && (m_msg[i].msg_hdr.msg_flags & MSG_TRUNC); }
+		struct sockaddr const* addr(size_t i) const { return (struct sockaddr const*)&m_addr[i]; }
+		socklen_t addrlen(size_t i) const { return i < m_size ? m_msg[i].msg_hdr.msg_namelen : 0; }
+
+		int recv(int sockfd, int flags = 0);
+		bool add(void const* buf, size_t len, struct sockaddr const* addr = NULL, socklen_t addrlen = 0);
+		int send(int sockfd, int flags = 0);
+	private:
+		MessageBatch(MessageBatch const&);
+		MessageBatch& operator=(MessageBatch const&);
+
+		size_t m_capacity;
+		size_t m_messageSize;
+		size_t m_size;
+		size_t m_sent;
+		char* m_buffer;
+		struct mmsghdr* m_msg;
+		struct iovec* m_iov;
+		struct sockaddr_storage* m_addr;
+	};
+#    endif
 	
 } } // namespace
 #  endif // __cplusplus
@@ -24,6 +24,7 @@
 #include <libzth/util.h>
 
 #include <functional>
+#include <limits>
 
 namespace zth {
 	
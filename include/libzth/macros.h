@@ -207,6 +207,10 @@ ZTH_EXPORT void foo();
 #  define ZTH_HAVE_PTHREAD
 //#  define ZTH_HAVE_LIBUNWIND
 #  define ZTH_HAVE_POLL
+#  define ZTH_HAVE_PPOLL
+#  define ZTH_HAVE_EVENTFD
+#  define ZTH_HAVE_EPOLL
+#  define ZTH_HAVE_SIGNALFD
 #  define ZTH_HAVE_MMAN
 #elif defined(__APPLE__)
 #  include "TargetConditionals.h"
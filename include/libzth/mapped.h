@@ -0,0 +1,61 @@
+#ifndef __ZTH_MAPPED_H
+#define __ZTH_MAPPED_H
+/*
+ * Zth (libzth), a cooperative userspace multitasking library.
+ * Copyright (C) 2019  Jochem Rutgers
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <libzth/macros.h>
+
+#if defined(__cplusplus) && defined(ZTH_HAVE_MMAN)
+#include <sys/types.h>
+
+namespace zth { namespace io {
+
+	/*!
+	 * \brief A file, mapped into memory.
+	 * \details Touching a page of the mapping that is not in memory blocks the whole worker on disk I/O.
+	 *          Call #prefetch() before accessing a range, such that only the calling fiber waits
+	 *          for the pages to be read, while other fibers continue.
+	 * \ingroup zth_api_cpp_io
+	 */
+	class ZTH_EXPORT MappedFile {
+	public:
+		MappedFile();
+		~MappedFile();
+
+		int open(char const* path, bool writable = false);
+		int map(int fd, size_t length = 0, off_t offset = 0, bool writable = false);
+		void close();
+
+		char* data() const { return m_data; }
+		size_t size() const { return m_size; }
+
+		bool resident(size_t offset = 0, size_t length = (size_t)-1) const;
+		int prefetch(size_t offset = 0, size_t length = (size_t)-1);
+	protected:
+		size_t nonResident(size_t offset, size_t end) const;
+	private:
+		MappedFile(MappedFile const&);
+		MappedFile& operator=(MappedFile const&);
+
+		char* m_data;
+		size_t m_size;
+	};
+
+} } // namespace
+#endif // __cplusplus && ZTH_HAVE_MMAN
+#endif // __ZTH_MAPPED_H
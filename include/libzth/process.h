@@ -0,0 +1,76 @@
+#ifndef __ZTH_PROCESS_H
+#define __ZTH_PROCESS_H
+/*
+ * Zth (libzth), a cooperative userspace multitasking library.
+ * Copyright (C) 2019  Jochem Rutgers
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <libzth/macros.h>
+
+#if defined(__cplusplus) && !defined(ZTH_OS_WINDOWS) && !defined(ZTH_OS_BAREMETAL)
+#include <signal.h>
+#include <sys/types.h>
+
+namespace zth {
+
+	/*!
+	 * \brief A child process, of which the standard streams can be connected to pipes.
+	 * \details The process is started by #spawn(), and its termination can be awaited by #wait(),
+	 *          while other fibers continue. The parent's ends of the pipes are non-blocking;
+	 *          use #read() and #write(), or zth::io::BufferedReader and zth::io::BufferedWriter on them.
+	 *
+	 *          When the object is destroyed before the process terminated, it is reaped in the background.
+	 *          Once #wait() returned, the object can #spawn() another process.
+	 * \ingroup zth_api_cpp_fiber
+	 */
+	class ZTH_EXPORT Process {
+	public:
+		enum Stream { Stdin = 0, Stdout = 1, Stderr = 2 };
+		enum { PipeStdin = 1, PipeStdout = 2, PipeStderr = 4, PipeAll = 7 };
+
+		Process();
+		~Process();
+
+		int spawn(char const* file, char* const argv[], int pipes = PipeAll, char* const envp[] = NULL);
+
+		pid_t pid() const { return m_pid; }
+		bool running() const { return m_pid > 0 && !m_exited; }
+		int fd(Stream stream) const { return m_fd[stream]; }
+		void close(Stream stream);
+
+		// Forward to read_(), as read() may be redirected to zth_read() by a macro.
+		ssize_t read(Stream stream, void* buf, size_t count) { return read_(stream, buf, count); }
+		ssize_t write(void const* buf, size_t count);
+
+		int kill(int sig = SIGTERM);
+		int wait(int* status = NULL);
+		int status() const { return m_status; }
+	protected:
+		ssize_t read_(Stream stream, void* buf, size_t count);
+	private:
+		Process(Process const&);
+		Process& operator=(Process const&);
+
+		pid_t m_pid;
+		int m_pidfd;
+		bool m_exited;
+		int m_status;
+		int m_fd[3];
+	};
+
+} // namespace
+#endif // __cplusplus && !ZTH_OS_WINDOWS && !ZTH_OS_BAREMETAL
+#endif // __ZTH_PROCESS_H
@@ -0,0 +1,366 @@
+#ifndef __ZTH_RING_H
+#define __ZTH_RING_H
+/*
+ * Zth (libzth), a cooperative userspace multitasking library.
+ * Copyright (C) 2019  Jochem Rutgers
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <libzth/macros.h>
+
+#if defined(__cplusplus) && defined(ZTH_HAVE_PTHREAD)
+#include <libzth/worker.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+#include <pthread.h>
+#include <vector>
+
+namespace zth {
+
+	namespace impl {
+#if __cplusplus >= 201103L
+		template <typename T> inline T&& ringMove(T& x) { return std::move(x); }
+#else
+		template <typename T> inline T& ringMove(T& x) { return x; }
+#endif
+
+		/*!
+		 * \brief Allocates \p size bytes, aligned to \p align, which may be more than \c ::operator \c new() guarantees.
+		 */
+		inline void* ringAlloc(size_t size, size_t align) {
+			void* p = NULL;
+			if(posix_memalign(&p, std::max(align, sizeof(void*)), size))
+				throw std::bad_alloc();
+			return p;
+		}
+
+		inline void ringFree(void* p) {
+			free(p);
+		}
+
+		/*!
+		 * \brief The Workers of which fibers wait for one side of a ring.
+		 * \details The lock is only taken when a fiber is going to wait, or when one is waiting.
+		 *          Every #wake() changes #seq(), such that the Waiter only wakes up the fibers of this side.
+		 */
+		class RingWaiters {
+		public:
+			RingWaiters() : m_count(), m_seq() { pthread_mutex_init(&m_lock, NULL); }
+			~RingWaiters() { pthread_mutex_destroy(&m_lock); }
+
+			/*!
+			 * \brief Let the next #wake() notify \p worker.
+			 * \details Check the condition again afterwards, before waiting.
+			 */
+			void add(Worker& worker) {
+				pthread_mutex_lock(&m_lock);
+				if(std::find(m_workers.begin(), m_workers.end(), &worker) == m_workers.end())
+					m_workers.push_back(&worker);
+				__atomic_store_n(&m_count, m_workers.size(), __ATOMIC_SEQ_CST);
+				pthread_mutex_unlock(&m_lock);
+				__atomic_thread_fence(__ATOMIC_SEQ_CST);
+			}
+
+			void wake() {
+				__atomic_thread_fence(__ATOMIC_SEQ_CST);
+				if(likely(!__atomic_load_n(&m_count, __ATOMIC_SEQ_CST)))
+					return;
+
+				std::vector<Worker*> workers;
+				pthread_mutex_lock(&m_lock);
+				workers.swap(m_workers);
+				__atomic_store_n(&m_count, 0, __ATOMIC_SEQ_CST);
+				pthread_mutex_unlock(&m_lock);
+
+				__atomic_add_fetch(&m_seq, 1, __ATOMIC_SEQ_CST);
+				for(size_t i = 0; i < workers.size(); i++)
+					workers[i]->notify();
+			}
+
+			/*!
+			 * \brief The word to pass to Waiter::waitNotify().
+			 */
+			int const* seq() const { return &m_seq; }
+
+		private:
+			RingWaiters(RingWaiters const&);
+			RingWaiters& operator=(RingWaiters const&);
+
+			pthread_mutex_t m_lock;
+			std::vector<Worker*> m_workers;
+			size_t m_count;
+			int m_seq;
+		};
+
+		/*!
+		 * \brief The blocking operations of a ring between workers, on top of the \c trypush_() and \c trypop_() of \p Ring.
+		 */
+		template <typename Ring, typename T>
+		class BlockingRing {
+		public:
+			typedef T type;
+
+			/*!
+			 * \brief Adds \p value, and waits for space when the ring is full.
+			 */
+			void push(type const& value) { type v(value); push_(v); }
+#if __cplusplus >= 201103L
+			void push(type&& value) { push_(value); }
+#endif
+
+			/*!
+			 * \brief Adds \p value, only when there is space.
+			 */
+			bool trypush(type const& value) {
+				type v(value);
+				if(!ring().trypush_(v))
+					return false;
+				m_notEmpty.wake();
+				return true;
+			}
+
+			/*!
+			 * \brief Moves \p count values into the ring, and waits for space when needed.
+			 */
+			void push_n(type* values, size_t count) {
+				for(size_t i = 0; i < count; i++)
+					wait(m_notFull, &Ring::trypush_, values[i], m_notEmpty);
+				m_notEmpty.wake();
+			}
+
+			/*!
+			 * \brief Moves the oldest value into \p value, and waits for one when the ring is empty.
+			 */
+			void pop(type& value) {
+				wait(m_notEmpty, &Ring::trypop_, value, m_notFull);
+				m_notFull.wake();
+			}
+
+			/*!
+			 * \brief Moves the oldest value into \p value, only when there is one.
+			 */
+			bool trypop(type& value) {
+				if(!ring().trypop_(value))
+					return false;
+				m_notFull.wake();
+				return true;
+			}
+
+			/*!
+			 * \brief Waits for at least one value, and then moves as many values as available, up to \p count.
+			 * \return the number of values received
+			 */
+			size_t pop_n(type* values, size_t count) {
+				if(!count)
+					return 0;
+
+				wait(m_notEmpty, &Ring::trypop_, values[0], m_notFull);
+				size_t i = 1;
+				while(i < count && ring().trypop_(values[i]))
+					i++;
+				m_notFull.wake();
+				return i;
+			}
+
+		protected:
+			Ring& ring() { return static_cast<Ring&>(*this); }
+
+			void push_(type& value) {
+				wait(m_notFull, &Ring::trypush_, value, m_notEmpty);
+				m_notEmpty.wake();
+			}
+
+			/*!
+			 * \brief Calls \p op till it succeeds, and waits for a notification from another worker in between.
+			 * \details When the ring is about to be full or empty, the other side might wait as well,
+			 *          so wake it first, before waiting.
+			 */
+			void wait(RingWaiters& waiters, bool (Ring::*op)(type&), type& value, RingWaiters& other) {
+				while(!(ring().*op)(value)) {
+					other.wake();
+					Worker& w = currentWorker();
+					// Take the sequence number before registering, as a wake() that unregisters us changes it.
+					int seq = __atomic_load_n(waiters.seq(), __ATOMIC_SEQ_CST);
+					waiters.add(w);
+					if((ring().*op)(value))
+						return;
+					w.waiter().waitNotify(waiters.seq(), seq);
+				}
+			}
+
+		private:
+			RingWaiters m_notEmpty;
+			RingWaiters m_notFull;
+		};
+	} // namespace impl
+
+	/*!
+	 * \brief A bounded lock-free ring to pass values from one fiber to one fiber, which may run in another Worker.
+	 * \details When the ring is empty or full, the fiber waits via zth::Waiter::waitNotify(),
+	 *          and the other side wakes it up via zth::Worker::notify() of its Worker.
+	 *          There is no lock on the path where no fiber has to wait.
+	 * \ingroup zth_api_cpp_sync
+	 */
+	template <typename T>
+	class SpscChannel : public impl::BlockingRing<SpscChannel<T>, T> {
+	public:
+		typedef T type;
+
+		explicit SpscChannel(size_t capacity = 64)
+			: m_buffer(), m_mask(), m_head(), m_tail()
+		{
+			size_t size = 2;
+			while(size < capacity)
+				size <<= 1;
+			m_mask = size - 1;
+			m_buffer = static_cast<type*>(impl::ringAlloc(size * sizeof(type), __alignof__(type)));
+		}
+
+		~SpscChannel() {
+			for(; m_head != m_tail; m_head++)
+				m_buffer[m_head & m_mask].~type();
+			impl::ringFree(m_buffer);
+		}
+
+		size_t capacity() const { return m_mask + 1; }
+		bool empty() const { return __atomic_load_n(&m_head, __ATOMIC_ACQUIRE) == __atomic_load_n(&m_tail, __ATOMIC_ACQUIRE); }
+
+	protected:
+		friend class impl::BlockingRing<SpscChannel<T>, T>;
+
+		bool trypush_(type& value) {
+			size_t tail = m_tail;
+			if(tail - __atomic_load_n(&m_head, __ATOMIC_ACQUIRE) > m_mask)
+				return false;
+
+			new(&m_buffer[tail & m_mask]) type(impl::ringMove(value));
+			__atomic_store_n(&m_tail, tail + 1, __ATOMIC_RELEASE);
+			return true;
+		}
+
+		bool trypop_(type& value) {
+			size_t head = m_head;
+			if(head == __atomic_load_n(&m_tail, __ATOMIC_ACQUIRE))
+				return false;
+
+			type& v = m_buffer[head & m_mask];
+			value = impl::ringMove(v);
+			v.~type();
+			__atomic_store_n(&m_head, head + 1, __ATOMIC_RELEASE);
+			return true;
+		}
+
+	private:
+		SpscChannel(SpscChannel const&);
+		SpscChannel& operator=(SpscChannel const&);
+
+		type* m_buffer;
+		size_t m_mask;
+		// Written by the consumer.
+		size_t m_head __attribute__((aligned(64)));
+		// Written by the producer.
+		size_t m_tail __attribute__((aligned(64)));
+	};
+
+	/*!
+	 * \brief A bounded lock-free ring to pass values from multiple fibers to one fiber, which may all run in different Workers.
+	 * \details Like zth::SpscChannel, but producers claim their slot by an atomic compare-and-swap.
+	 * \ingroup zth_api_cpp_sync
+	 */
+	template <typename T>
+	class MpscChannel : public impl::BlockingRing<MpscChannel<T>, T> {
+	public:
+		typedef T type;
+
+		explicit MpscChannel(size_t capacity = 64)
+			: m_cells(), m_mask(), m_head(), m_tail()
+		{
+			size_t size = 2;
+			while(size < capacity)
+				size <<= 1;
+			m_mask = size - 1;
+			m_cells = static_cast<Cell*>(impl::ringAlloc(size * sizeof(Cell), __alignof__(Cell)));
+			for(size_t i = 0; i < size; i++)
+				m_cells[i].sequence = i;
+		}
+
+		~MpscChannel() {
+			for(; m_cells[m_head & m_mask].sequence == m_head + 1; m_head++)
+				reinterpret_cast<type*>(m_cells[m_head & m_mask].data)->~type();
+			impl::ringFree(m_cells);
+		}
+
+		size_t capacity() const { return m_mask + 1; }
+
+	protected:
+		friend class impl::BlockingRing<MpscChannel<T>, T>;
+
+		bool trypush_(type& value) {
+			size_t tail = __atomic_load_n(&m_tail, __ATOMIC_RELAXED);
+			while(true) {
+				Cell& cell = m_cells[tail & m_mask];
+				size_t sequence = __atomic_load_n(&cell.sequence, __ATOMIC_ACQUIRE);
+				if(sequence == tail) {
+					// The cell is free; claim it.
+					if(__atomic_compare_exchange_n(&m_tail, &tail, tail + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+						new(cell.data) type(impl::ringMove(value));
+						__atomic_store_n(&cell.sequence, tail + 1, __ATOMIC_RELEASE);
+						return true;
+					}
+					// tail was updated by the compare-exchange.
+				} else if((ptrdiff_t)(sequence - tail) < 0) {
+					// The consumer did not free this cell yet; full.
+					return false;
+				} else {
+					tail = __atomic_load_n(&m_tail, __ATOMIC_RELAXED);
+				}
+			}
+		}
+
+		bool trypop_(type& value) {
+			size_t head = m_head;
+			Cell& cell = m_cells[head & m_mask];
+			if(__atomic_load_n(&cell.sequence, __ATOMIC_ACQUIRE) != head + 1)
+				return false;
+
+			type& v = *reinterpret_cast<type*>(cell.data);
+			value = impl::ringMove(v);
+			v.~type();
+			__atomic_store_n(&cell.sequence, head + m_mask + 1, __ATOMIC_RELEASE);
+			m_head = head + 1;
+			return true;
+		}
+
+	private:
+		MpscChannel(MpscChannel const&);
+		MpscChannel& operator=(MpscChannel const&);
+
+		struct Cell {
+			size_t sequence;
+			char data[sizeof(type)] __attribute__((aligned(__alignof__(type))));
+		};
+
+		Cell* m_cells;
+		size_t m_mask;
+		// Only used by the consumer.
+		size_t m_head __attribute__((aligned(64)));
+		size_t m_tail __attribute__((aligned(64)));
+	};
+
+} // namespace
+#endif // __cplusplus && ZTH_HAVE_PTHREAD
+#endif // __ZTH_RING_H
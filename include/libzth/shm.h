@@ -0,0 +1,86 @@
+#ifndef __ZTH_SHM_H
+#define __ZTH_SHM_H
+/*
+ * Zth (libzth), a cooperative userspace multitasking library.
+ * Copyright (C) 2019  Jochem Rutgers
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <libzth/macros.h>
+
+#if defined(__cplusplus) && defined(ZTH_HAVE_EVENTFD) && defined(ZTH_HAVE_MMAN)
+#include <stdint.h>
+#include <sys/types.h>
+
+namespace zth {
+
+	/*!
+	 * \brief A channel of messages between two processes on the same host, via shared memory.
+	 * \details The messages are stored in a ring buffer in a shared memory segment, which is written by one
+	 *          fiber in one process, and read by one fiber in the other process.
+	 *          When the ring is empty or full, the fiber waits via the zth::Waiter for an eventfd,
+	 *          which is signalled by the other side.
+	 *
+	 *          One process calls #create(), and passes the three #fds() to the other one,
+	 *          by inheritance or via a Unix domain socket. That process then calls #attach().
+	 *          Use two channels for bidirectional communication.
+	 *          Outside of a fiber, calls that would wait fail with \c EAGAIN instead.
+	 * \ingroup zth_api_cpp_io
+	 */
+	class ZTH_EXPORT ShmChannel {
+	public:
+		ShmChannel();
+		~ShmChannel();
+
+		int create(size_t size = 0x10000);
+		int attach(int shmFd, int dataFd, int spaceFd);
+		void fds(int& shmFd, int& dataFd, int& spaceFd) const;
+		void shutdown();
+		bool isShutdown() const;
+		size_t maxMessage() const;
+
+		void* reserve(size_t length);
+		void commit();
+		void const* peek(size_t& length);
+		void release();
+
+		ssize_t send(void const* buf, size_t length);
+		ssize_t recv(void* buf, size_t length);
+	protected:
+		struct Header;
+
+		int map(bool attach);
+		void reset();
+		int waitFor(int fd);
+		void ring(int fd, uint32_t* waiting);
+	private:
+		ShmChannel(ShmChannel const&);
+		ShmChannel& operator=(ShmChannel const&);
+
+		Header* m_header;
+		char* m_ring;
+		// The size of the ring, as mapped. The one in the header may be changed by the other side.
+		size_t m_size;
+		int m_shmFd;
+		// Signalled by the writer when a message was committed.
+		int m_dataFd;
+		// Signalled by the reader when a message was released.
+		int m_spaceFd;
+		size_t m_pending;
+	};
+
+} // namespace
+#endif // __cplusplus && ZTH_HAVE_EVENTFD && ZTH_HAVE_MMAN
+#endif // __ZTH_SHM_H
@@ -35,6 +35,7 @@
 #include <libzth/util.h>
 
 #include <new>
+#include <vector>
 
 #ifdef ZTH_USE_VALGRIND
 #  include <valgrind/memcheck.h>
@@ -78,7 +79,7 @@ namespace zth {
 		}
 		
 		SharedPointer& operator=(RefCounted* object) { reset(object); return *this; }
-		SharedPointer& operator=(SharedPointer const& p) { reset(p.get()); }
+		SharedPointer& operator=(SharedPointer const& p) { reset(p.get()); return *this; }
 		
 		T* get() const { return m_object ? static_cast<T*>(m_object) : NULL; }
 		operator T*() const { return get(); }
@@ -95,42 +96,253 @@ namespace zth {
 		RefCounted* m_object;
 	};
 
+	namespace impl {
+		/*!
+		 * \brief A fiber that waits in zth::WaitAny for multiple Synchronizers, fds and a timeout at the same time.
+		 * \details Whatever claims it first wakes up the fiber; others leave it alone from then on.
+		 */
+		struct AnyWait {
+			explicit AnyWait(Fiber& fiber) : fiber(fiber), alarm(), fired(-1), done() {
+#ifdef ZTH_HAVE_POLLER
+				fds = NULL;
+#endif
+			}
+
+			bool claim(int index) {
+				if(done)
+					return false;
+#ifdef ZTH_HAVE_POLLER
+				if(fds) {
+					if(fds->finished())
+						// The Waiter woke it up already.
+						return false;
+					// Let the Waiter skip the fds from now on.
+					fds->setResult(0);
+				}
+#endif
+				done = true;
+				fired = index;
+				return true;
+			}
+
+			Fiber& fiber;
+			TimedWaitable* alarm;
+#ifdef ZTH_HAVE_POLLER
+			AwaitFd* fds;
+#endif
+			// The index of the Synchronizer that woke up the fiber, or -1.
+			int fired;
+			bool done;
+		};
+
+		class AnyAlarm : public TimedWaitable {
+		public:
+			AnyAlarm(AnyWait& wait, Timestamp const& timeout)
+				: TimedWaitable(timeout), m_wait(wait) { setFiber(wait.fiber); }
+			virtual ~AnyAlarm() {}
+
+			virtual bool poll(Timestamp const& now = Timestamp::now()) {
+				if(!TimedWaitable::poll(now))
+					return false;
+				// The Waiter wakes up the fiber.
+				m_wait.alarm = NULL;
+				m_wait.done = true;
+				return true;
+			}
+		private:
+			AnyWait& m_wait;
+		};
+	} // namespace impl
+
+	template <size_t N> class WaitAny;
+
 	class Synchronizer : public RefCounted, public UniqueID<Synchronizer> {
 	public:
-		Synchronizer(char const* name = "Synchronizer") : RefCounted(), UniqueID(Config::NamedSynchronizer ? name : NULL) {}
+		Synchronizer(char const* name = "Synchronizer")
+			: RefCounted(), UniqueID(Config::NamedSynchronizer ? name : NULL), m_handoff(NoHandoff) {}
 		virtual ~Synchronizer() {
 			zth_dbg(sync, "[%s] Destruct", id_str());
 			zth_assert(m_queue.empty());
 		}
 
+		/*!
+		 * \brief The reason why a timed wait on a Synchronizer returned.
+		 */
+		enum WaitResult { Unblocked = 0, TimedOut, Cancelled };
+
+		/*!
+		 * \brief What the waker does after waking up a single fiber.
+		 * \details By default, the woken fiber is only put in the runnable queue.
+		 *          With #SwitchOnWake, the waker switches to it immediately, which cuts the latency of
+		 *          request/response between fibers. #DonateOnWake also lets the woken fiber run for
+		 *          (at least) the rest of the timeslice of the waker.
+		 *
+		 *          The switch is only done as the last step of an operation that completes the state
+		 *          change of the Synchronizer, which are Mutex::unlock(), Semaphore::release() and Signal::signal().
+		 *          Other operations, such as ConditionVariable::wait() unlocking its Mutex, never hand off.
+		 */
+		enum Handoff { NoHandoff = 0, SwitchOnWake, DonateOnWake };
+
+		Handoff handoff() const { return m_handoff; }
+		void setHandoff(Handoff handoff) { m_handoff = handoff; }
+
+		/*!
+		 * \brief Lets \p fiber return from its timed wait on this Synchronizer with #Cancelled.
+		 * \details Only waits that report a #WaitResult can be cancelled.
+		 * \return \c true when \p fiber was cancelled, \c false when it was not waiting for this Synchronizer
+		 */
+		bool cancel(Fiber& fiber) {
+			for(List<Blocked>::iterator it = m_queue.begin(); it != m_queue.end(); ++it) {
+				Blocked& b = *it;
+				if(&b.fiber != &fiber || !b.cancellable)
+					continue;
+
+				Worker* w;
+				getContext(&w, NULL);
+
+				zth_dbg(sync, "[%s] Cancel %s", id_str(), fiber.id_str());
+				m_queue.erase(it);
+				b.result = Cancelled;
+				unblock(*w, b);
+				return true;
+			}
+			return false;
+		}
+
 	protected:
+		class AlarmClock;
+
+		/*!
+		 * \brief A fiber in the queue of a Synchronizer, which lives on the stack of that fiber.
+		 */
+		struct Blocked : public Listable<Blocked> {
+			explicit Blocked(Fiber& fiber, bool cancellable = false)
+				: fiber(fiber), alarm(), result(Unblocked), cancellable(cancellable), any(), index(-1) {}
+			Fiber& fiber;
+			AlarmClock* alarm;
+			WaitResult result;
+			bool cancellable;
+			// For zth::WaitAny: the state shared with the fiber's nodes in other Synchronizers, and the index of this one.
+			impl::AnyWait* any;
+			int index;
+		};
+
+		/*!
+		 * \brief Removes a Blocked fiber from the queue when its timeout has passed.
+		 */
+		class AlarmClock : public TimedWaitable {
+		public:
+			AlarmClock(Synchronizer& synchronizer, Blocked& blocked, Timestamp const& timeout)
+				: TimedWaitable(timeout), m_synchronizer(synchronizer), m_blocked(blocked)
+			{
+				setFiber(blocked.fiber);
+				blocked.alarm = this;
+			}
+			virtual ~AlarmClock() {}
+
+			virtual bool poll(Timestamp const& now = Timestamp::now()) {
+				if(!TimedWaitable::poll(now))
+					return false;
+
+				zth_dbg(sync, "[%s] Timeout of %s", m_synchronizer.id_str(), m_blocked.fiber.id_str());
+				m_synchronizer.m_queue.erase(m_blocked);
+				m_blocked.alarm = NULL;
+				m_blocked.result = TimedOut;
+				// The Waiter wakes up the fiber.
+				return true;
+			}
+
+		private:
+			Synchronizer& m_synchronizer;
+			Blocked& m_blocked;
+		};
+
 		void block() {
 			Worker* w;
 			Fiber* f;
 			getContext(&w, &f);
 
 			zth_dbg(sync, "[%s] Block %s", id_str(), f->id_str());
-			w->release(*f);
-			m_queue.push_back(*f);
-			f->nap(Timestamp::null());
-			w->schedule();
+			Blocked b(*f);
+			park(*w, b, NULL);
 		}
 
-		bool unblockFirst() {
+		/*!
+		 * \brief Like #block(), but give up at \p timeout, or when cancelled.
+		 * \param timeout the time to give up, or Timestamp::null() to wait till unblocked or cancelled
+		 */
+		WaitResult block(Timestamp const& timeout) {
+			if(!timeout.isNull() && timeout <= Timestamp::now())
+				return TimedOut;
+
+			Worker* w;
+			Fiber* f;
+			getContext(&w, &f);
+
+			Blocked b(*f, true);
+			if(timeout.isNull()) {
+				zth_dbg(sync, "[%s] Block %s", id_str(), f->id_str());
+				park(*w, b, NULL);
+			} else {
+				zth_dbg(sync, "[%s] Block %s with %s timeout", id_str(), f->id_str(),
+					(timeout - Timestamp::now()).str().c_str());
+				AlarmClock a(*this, b, timeout);
+				park(*w, b, &a);
+			}
+			return b.result;
+		}
+
+		/*!
+		 * \brief Wakes up the first blocked fiber.
+		 * \details This never switches to the woken fiber; pass the result to #handoff() when done.
+		 * \return the woken fiber, or \c NULL when nobody was waiting
+		 */
+		Fiber* unblockFirst() {
 			if(m_queue.empty())
-				return false;
+				return NULL;
 
 			Worker* w;
 			getContext(&w, NULL);
 
-			Fiber& f = m_queue.front();
-			zth_dbg(sync, "[%s] Unblock %s", id_str(), f.id_str());
-			m_queue.pop_front();
-			f.wakeup();
-			w->add(&f);
-			return true;
+			while(!m_queue.empty()) {
+				Blocked& b = m_queue.front();
+				m_queue.pop_front();
+				// b is gone as soon as the fiber runs.
+				Fiber& f = b.fiber;
+				if(unblock(*w, b)) {
+					zth_dbg(sync, "[%s] Unblocked %s", id_str(), f.id_str());
+					return &f;
+				}
+			}
+			return NULL;
 		}
 
+		/*!
+		 * \brief Switches from the current fiber to \p to, which was just woken up, according to #handoff().
+		 * \details Only call this when the state change of this Synchronizer is complete,
+		 *          and the current fiber is not about to block.
+		 */
+		void handoff(Fiber* to) {
+			if(likely(m_handoff == NoHandoff) || !to)
+				return;
+
+			Worker* w;
+			getContext(&w, NULL);
+
+			Fiber* f = w->currentFiber();
+			if(!f || to->state() != Fiber::Ready)
+				// Not called by a fiber, or the woken fiber is suspended.
+				return;
+
+			zth_dbg(sync, "[%s] Hand off %s to %s", id_str(), f->id_str(), to->id_str());
+			if(m_handoff == DonateOnWake)
+				to->donateTimeslice(f->stateEnd());
+			w->handoff(*to);
+		}
+
+		/*!
+		 * \return \c true when at least one fiber was woken up
+		 */
 		bool unblockAll() {
 			if(m_queue.empty())
 				return false;
@@ -140,17 +352,101 @@ namespace zth {
 
 			zth_dbg(sync, "[%s] Unblock all", id_str());
 
+			bool res = false;
 			while(!m_queue.empty()) {
-				Fiber& f = m_queue.front();
+				Blocked& b = m_queue.front();
 				m_queue.pop_front();
-				f.wakeup();
-				w->add(&f);
+				if(unblock(*w, b))
+					res = true;
 			}
-			return true;
+			return res;
+		}
+
+		/*!
+		 * \brief Moves the first blocked fiber to the queue of \p to, without waking it up.
+		 * \details A timeout of the fiber is cancelled, as it is waiting for \p to now.
+		 */
+		bool requeueFirst(Synchronizer& to) {
+			if(m_queue.empty())
+				return false;
+
+			Worker* w;
+			getContext(&w, NULL);
+
+			while(!m_queue.empty()) {
+				Blocked& b = m_queue.front();
+				m_queue.pop_front();
+
+				if(b.any) {
+					// Its other nodes are not moved along, so just wake it up.
+					if(unblock(*w, b))
+						return true;
+					continue;
+				}
+
+				zth_dbg(sync, "[%s] Requeue %s to %s", id_str(), b.fiber.id_str(), to.id_str());
+				if(b.alarm) {
+					w->waiter().unscheduleTask(*b.alarm);
+					b.alarm = NULL;
+				}
+
+				to.m_queue.push_back(b);
+				return true;
+			}
+			return false;
+		}
+
+		void enqueue(Blocked& b) {
+			m_queue.push_back(b);
+		}
+
+		/*!
+		 * \brief Removes \p b from the queue, when it is still there.
+		 */
+		void dequeue(Blocked& b) {
+			if(m_queue.contains(b))
+				m_queue.erase(b);
 		}
 
 	private:
-		List<Fiber> m_queue;
+		void park(Worker& w, Blocked& b, AlarmClock* alarm) {
+			w.release(b.fiber);
+			m_queue.push_back(b);
+			b.fiber.nap(Timestamp::null());
+			if(alarm)
+				w.waiter().scheduleTask(*alarm);
+			w.schedule();
+		}
+
+		/*!
+		 * \return \c false when the fiber was woken up by something else already
+		 */
+		static bool unblock(Worker& w, Blocked& b) {
+			if(b.any) {
+				if(!b.any->claim(b.index))
+					return false;
+				if(b.any->alarm) {
+					w.waiter().unscheduleTask(*b.any->alarm);
+					b.any->alarm = NULL;
+				}
+			}
+
+			if(b.alarm) {
+				w.waiter().unscheduleTask(*b.alarm);
+				b.alarm = NULL;
+			}
+
+			// b is gone as soon as the fiber runs.
+			Fiber& f = b.fiber;
+			f.wakeup();
+			w.add(&f);
+			return true;
+		}
+
+		List<Blocked> m_queue;
+		Handoff m_handoff;
+
+		template <size_t N> friend class WaitAny;
 	};
 
 	/*!
@@ -168,6 +464,23 @@ namespace zth {
 			zth_dbg(sync, "[%s] Locked", id_str());
 		}
 
+		/*!
+		 * \brief Like #lock(), but give up at \p timeout, or when cancelled.
+		 * \return #Unblocked when the mutex is locked
+		 */
+		WaitResult lockUntil(Timestamp const& timeout) {
+			while(unlikely(m_locked)) {
+				WaitResult res = block(timeout);
+				if(res != Unblocked)
+					return res;
+			}
+			m_locked = true;
+			zth_dbg(sync, "[%s] Locked", id_str());
+			return Unblocked;
+		}
+
+		WaitResult lockFor(TimeInterval const& timeout) { return lockUntil(Timestamp::now() + timeout); }
+
 		bool trylock() {
 			if(m_locked)
 				return false;
@@ -177,14 +490,115 @@ namespace zth {
 		}
 
 		void unlock() {
+			handoff(unlock_());
+		}
+
+		bool locked() const { return m_locked; }
+
+	protected:
+		/*!
+		 * \brief Unlocks the mutex, without handing off to the woken fiber.
+		 * \return the woken fiber, if any
+		 */
+		Fiber* unlock_() {
 			zth_assert(m_locked);
 			zth_dbg(sync, "[%s] Unlocked", id_str());
 			m_locked = false;
-			unblockFirst();
+			return unblockFirst();
+		}
+
+		friend class ConditionVariable;
+
+	private:
+		bool m_locked;
+	};
+
+	/*!
+	 * \brief A mutex that can be locked by multiple readers at the same time, or by one writer.
+	 * \details Waiting writers are in the queue of this Synchronizer, waiting readers in a second one.
+	 *          Without writer preference, readers can enter as long as no writer holds the lock,
+	 *          which may starve writers. With writer preference, new readers wait as soon as a writer waits.
+	 * \ingroup zth_api_cpp_sync
+	 */
+	class SharedMutex : public Synchronizer {
+	public:
+		SharedMutex(bool preferWriter = false, char const* name = "SharedMutex")
+			: Synchronizer(name), m_readers(name), m_shared(), m_writersWaiting(), m_locked(), m_preferWriter(preferWriter) {}
+		virtual ~SharedMutex() {}
+
+		bool preferWriter() const { return m_preferWriter; }
+
+		void lock() {
+			while(unlikely(m_locked || m_shared)) {
+				m_writersWaiting++;
+				block();
+				m_writersWaiting--;
+			}
+			m_locked = true;
+			zth_dbg(sync, "[%s] Locked", id_str());
+		}
+
+		bool trylock() {
+			if(m_locked || m_shared)
+				return false;
+			m_locked = true;
+			zth_dbg(sync, "[%s] Locked", id_str());
+			return true;
 		}
 
+		void unlock() {
+			zth_assert(m_locked);
+			zth_dbg(sync, "[%s] Unlocked", id_str());
+			m_locked = false;
+			if(m_preferWriter && m_writersWaiting) {
+				unblockFirst();
+			} else if(!m_readers.unblockAll()) {
+				unblockFirst();
+			}
+		}
+
+		void lockShared() {
+			while(unlikely(!mayShare()))
+				m_readers.block();
+			m_shared++;
+			zth_dbg(sync, "[%s] Locked shared by %zu", id_str(), m_shared);
+		}
+
+		bool trylockShared() {
+			if(!mayShare())
+				return false;
+			m_shared++;
+			zth_dbg(sync, "[%s] Locked shared by %zu", id_str(), m_shared);
+			return true;
+		}
+
+		void unlockShared() {
+			zth_assert(m_shared > 0);
+			zth_dbg(sync, "[%s] Unlocked shared", id_str());
+			if(--m_shared == 0)
+				unblockFirst();
+		}
+
+		bool locked() const { return m_locked; }
+		size_t shared() const { return m_shared; }
+
+	protected:
+		bool mayShare() const { return !m_locked && !(m_preferWriter && m_writersWaiting); }
+
 	private:
+		class Readers : public Synchronizer {
+		public:
+			explicit Readers(char const* name) : Synchronizer(name) {}
+			virtual ~Readers() {}
+			using Synchronizer::block;
+			using Synchronizer::unblockAll;
+		};
+
+		Readers m_readers;
+		size_t m_shared;
+		size_t m_writersWaiting;
 		bool m_locked;
+		bool m_preferWriter;
 	};
 
 	/*!
@@ -210,178 +624,1429 @@ namespace zth {
 					block();
 				}
 			}
-			zth_dbg(sync, "[%s] Acquired %zu", id_str(), count);
-		}
+			zth_dbg(sync, "[%s] Acquired %zu", id_str(), count);
+		}
+
+		/*!
+		 * \brief Like #acquire(), but give up at \p timeout, or when cancelled.
+		 * \details When giving up, the part of \p count that was acquired already is released again.
+		 * \return #Unblocked when \p count is acquired
+		 */
+		WaitResult acquireUntil(size_t count, Timestamp const& timeout) {
+			size_t remaining = count;
+			while(true) {
+				if(remaining <= m_count) {
+					m_count -= remaining;
+					if(m_count > 0)
+						// There might be another one waiting.
+						unblockFirst();
+					zth_dbg(sync, "[%s] Acquired %zu", id_str(), count);
+					return Unblocked;
+				}
+
+				remaining -= m_count;
+				m_count = 0;
+				WaitResult res = block(timeout);
+				if(res != Unblocked) {
+					if(remaining < count)
+						release(count - remaining);
+					return res;
+				}
+			}
+		}
+
+		WaitResult acquireFor(size_t count, TimeInterval const& timeout) { return acquireUntil(count, Timestamp::now() + timeout); }
+
+		void release(size_t count = 1) {
+			zth_assert(m_count + count >= m_count); // ...otherwise it wrapped around, which is probably not want you wanted...
+
+			if(unlikely(m_count + count < m_count))
+				// wrapped around, saturate
+				m_count = std::numeric_limits<size_t>::max();
+			else
+				m_count += count;
+			
+			zth_dbg(sync, "[%s] Released %zu", id_str(), count);
+
+			if(likely(m_count > 0))
+				handoff(unblockFirst());
+		}
+
+		size_t value() const { return m_count; }
+
+	private:
+		size_t m_count;
+	};
+
+	/*!
+	 * \ingroup zth_api_cpp_sync
+	 */
+	class Signal : public Synchronizer {
+	public:
+		Signal(char const* name = "Signal") : Synchronizer(name) , m_signalled() {}
+		virtual ~Signal() {}
+
+		void wait() {
+			if(!m_signalled)
+				block();
+			else
+				// Do a yield() here, as one might rely on the signal to block
+				// regularly when the signal is used in a loop (see daemon
+				// pattern).
+				yield();
+
+			if(m_signalled > 0)
+				m_signalled--;
+		}
+
+		/*!
+		 * \brief Like #wait(), but give up at \p timeout.
+		 * \return \c true when signalled, \c false when the timeout has passed
+		 */
+		bool wait(Timestamp const& timeout) {
+			return waitUntil(timeout) == Unblocked;
+		}
+
+		/*!
+		 * \brief Like #wait(), but give up at \p timeout, or when cancelled.
+		 */
+		WaitResult waitUntil(Timestamp const& timeout) {
+			if(!m_signalled) {
+				WaitResult res = block(timeout);
+				if(res != Unblocked)
+					return res;
+			} else
+				yield();
+
+			if(m_signalled > 0)
+				m_signalled--;
+			return Unblocked;
+		}
+
+		WaitResult waitFor(TimeInterval const& timeout) { return waitUntil(Timestamp::now() + timeout); }
+
+		/*!
+		 * \brief Waits for the next #signal() or #signalAll(), or \p timeout, regardless of a queued signal.
+		 * \details A queued signal is neither taken nor does it return immediately.
+		 */
+		WaitResult waitNext(Timestamp const& timeout = Timestamp::null()) {
+			return block(timeout);
+		}
+
+		/*!
+		 * \brief Takes a queued signal, without waiting.
+		 * \return \c true when the signal was queued
+		 */
+		bool trywait() {
+			if(!m_signalled)
+				return false;
+			if(m_signalled > 0)
+				m_signalled--;
+			return true;
+		}
+
+		void signal(bool queue = true, bool queueEveryTime = false) {
+			zth_dbg(sync, "[%s] Signal", id_str());
+			Fiber* f = unblockFirst();
+			if(f) {
+				handoff(f);
+			} else if(queue && m_signalled >= 0) {
+				if(m_signalled == 0 || queueEveryTime)
+					m_signalled++;
+				zth_assert(m_signalled > 0); // Otherwise, it wrapped around, which is probably not what you want.
+			}
+		}
+
+		void signalAll(bool queue = true) {
+			zth_dbg(sync, "[%s] Signal all", id_str());
+			unblockAll();
+			if(queue)
+				m_signalled = -1;
+		}
+
+		void reset() {
+			m_signalled = 0;
+		}
+
+	private:
+		int m_signalled;
+	};
+
+	/*!
+	 * \brief Wait until \p f returns \c true, while evaluating it only when \p signal is signalled.
+	 * \details Contrary to zth::waitUntil(F, TimeInterval const&), the fiber does not wake up while nothing happens.
+	 *          Make sure to signal \p signal whenever the outcome of \p f might have changed.
+	 *          As \p f is the actual condition, queued signals are ignored (see Signal::waitNext()),
+	 *          so a sticky \c signalAll() does not make this function spin.
+	 *          Use \c signalAll(false) when multiple fibers may wait, as Signal::signal() only wakes one of them.
+	 * \return \c true when \p f returned \c true, \c false when \p timeout has passed first
+	 * \ingroup zth_api_cpp_sync
+	 */
+	template <typename F>
+	bool waitUntil(Signal& signal, F f, Timestamp const& timeout = Timestamp::null()) {
+		while(!f())
+			if(signal.waitNext(timeout) != Synchronizer::Unblocked)
+				return f();
+		return true;
+	}
+
+	/*!
+	 * \copydoc zth::waitUntil(Signal&, F, Timestamp const&)
+	 * \ingroup zth_api_cpp_sync
+	 */
+	template <typename F>
+	bool waitUntil(Signal& signal, F f, TimeInterval const& timeout) {
+		return waitUntil(signal, f, Timestamp::now() + timeout);
+	}
+
+	/*!
+	 * \brief A condition variable, to be used with a zth::Mutex.
+	 * \details When the Mutex is locked while notifying, the waiting fiber is moved to the queue of the Mutex,
+	 *          instead of waking it up only to block on the Mutex again (wait morphing).
+	 *          All waiters must use the same Mutex.
+	 * \ingroup zth_api_cpp_sync
+	 */
+	class ConditionVariable : public Synchronizer {
+	public:
+		ConditionVariable(char const* name = "ConditionVariable") : Synchronizer(name), m_mutex() {}
+		virtual ~ConditionVariable() {}
+
+		/*!
+		 * \brief Unlocks \p mutex, waits for a notification, and locks \p mutex again.
+		 */
+		void wait(Mutex& mutex) {
+			enter(mutex);
+			block();
+			mutex.lock();
+		}
+
+		/*!
+		 * \brief Like #wait(), but give up at \p timeout, or when cancelled.
+		 * \details \p mutex is locked again in all cases.
+		 */
+		WaitResult waitUntil(Mutex& mutex, Timestamp const& timeout) {
+			enter(mutex);
+			WaitResult res = block(timeout);
+			mutex.lock();
+			return res;
+		}
+
+		WaitResult waitFor(Mutex& mutex, TimeInterval const& timeout) { return waitUntil(mutex, Timestamp::now() + timeout); }
+
+		void notifyOne() {
+			zth_dbg(sync, "[%s] Notify one", id_str());
+			if(m_mutex && m_mutex->locked())
+				requeueFirst(*m_mutex);
+			else
+				unblockFirst();
+		}
+
+		void notifyAll() {
+			zth_dbg(sync, "[%s] Notify all", id_str());
+			if(m_mutex && m_mutex->locked())
+				while(requeueFirst(*m_mutex));
+			else
+				unblockAll();
+		}
+
+	protected:
+		void enter(Mutex& mutex) {
+			zth_assert(mutex.locked());
+			zth_assert(!m_mutex || m_mutex == &mutex);
+			m_mutex = &mutex;
+			// Don't hand off, as this fiber is not queued yet.
+			mutex.unlock_();
+		}
+
+	private:
+		Mutex* m_mutex;
+	};
+
+	class FutureBase;
+
+	/*!
+	 * \brief A continuation of a zth::Future, which is called when the Future is set.
+	 * \details The object is owned by the caller, and must stay alive till it is called, or removed by FutureBase::forget().
+	 *          #ready() is called by the fiber that sets the Future, so it must not block.
+	 * \ingroup zth_api_cpp_sync
+	 */
+	class FutureCallback : public Listable<FutureCallback> {
+	public:
+		virtual ~FutureCallback() {}
+		virtual void ready(FutureBase& future) = 0;
+	};
+
+	/*!
+	 * \brief The part of zth::Future that does not depend on the type of the value.
+	 * \ingroup zth_api_cpp_sync
+	 */
+	class FutureBase : public Synchronizer {
+	public:
+		FutureBase(char const* name = "Future") : Synchronizer(name), m_valid() {}
+		virtual ~FutureBase() {
+			zth_assert(m_callbacks.empty());
+		}
+
+		bool valid() const { return m_valid; }
+		operator bool() const { return valid(); }
+
+		void wait() { if(!valid()) block(); }
+		WaitResult waitUntil(Timestamp const& timeout) { return valid() ? Unblocked : block(timeout); }
+		WaitResult waitFor(TimeInterval const& timeout) { return waitUntil(Timestamp::now() + timeout); }
+
+		/*!
+		 * \brief Calls \p callback when this Future is set, or right away when it is valid already.
+		 */
+		void then(FutureCallback& callback) {
+			if(valid())
+				callback.ready(*this);
+			else
+				m_callbacks.push_back(callback);
+		}
+
+		/*!
+		 * \brief Removes a \p callback that was passed to #then(), and was not called yet.
+		 */
+		void forget(FutureCallback& callback) {
+			if(m_callbacks.contains(callback))
+				m_callbacks.erase(callback);
+		}
+
+	protected:
+		void setValid() {
+			m_valid = true;
+			zth_dbg(sync, "[%s] Set", id_str());
+			unblockAll();
+
+			while(!m_callbacks.empty()) {
+				FutureCallback& callback = m_callbacks.front();
+				m_callbacks.pop_front();
+				callback.ready(*this);
+			}
+		}
+
+	private:
+		List<FutureCallback> m_callbacks;
+		bool m_valid;
+	};
+
+	/*!
+	 * \ingroup zth_api_cpp_sync
+	 */
+	template <typename T = void>
+	class Future : public FutureBase {
+	public:
+		typedef T type;
+		Future(char const* name = "Future") : FutureBase(name) {
+#ifdef ZTH_USE_VALGRIND
+			VALGRIND_MAKE_MEM_NOACCESS(m_data, sizeof(m_data));
+#endif
+		}
+		virtual ~Future() {
+			if(valid())
+				value().~type();
+#ifdef ZTH_USE_VALGRIND
+			VALGRIND_MAKE_MEM_UNDEFINED(m_data, sizeof(m_data));
+#endif
+		}
+
+		void set(type const& value = type()) {
+			zth_assert(!valid());
+			if(valid())
+				return;
+#ifdef ZTH_USE_VALGRIND
+			VALGRIND_MAKE_MEM_UNDEFINED(m_data, sizeof(m_data));
+#endif
+			new(m_data) type(value);
+			setValid();
+		}
+#if __cplusplus >= 201103L
+		void set(type&& value) {
+			zth_assert(!valid());
+			if(valid())
+				return;
+#  ifdef ZTH_USE_VALGRIND
+			VALGRIND_MAKE_MEM_UNDEFINED(m_data, sizeof(m_data));
+#  endif
+			new(m_data) type(std::move(value));
+			setValid();
+		}
+#endif
+		Future& operator=(type const& value) { set(value); return *this; }
+
+		/*!
+		 * \brief Waits for the value, and moves it out.
+		 * \details The Future stays valid, but holds the moved-from value afterwards.
+		 *          This allows move-only types to be passed through a Future.
+		 */
+		type take() {
+#if __cplusplus >= 201103L
+			return std::move(value());
+#else
+			return value();
+#endif
+		}
+
+		type& value() { wait(); char* p = m_data; return *reinterpret_cast<type*>(p); }
+		type const& value() const { const_cast<Future*>(this)->wait(); char const* p = m_data; return *reinterpret_cast<type const*>(p); }
+		operator type const&() const { return value(); }
+		operator type&() { return value(); }
+		type const* operator*() const { return &value(); }
+		type* operator*() { return &value(); }
+		type const* operator->() const { return &value(); }
+		type* operator->() { return &value(); }
+	private:
+		char m_data[sizeof(type)] __attribute__((aligned(8)));
+	};
+	
+	template <>
+	class Future<void> : public FutureBase {
+	public:
+		typedef void type;
+		Future(char const* name = "Future") : FutureBase(name) {}
+		virtual ~Future() {}
+
+		void set() {
+			zth_assert(!valid());
+			if(valid())
+				return;
+			setValid();
+		}
+	};
+
+	/*!
+	 * \brief The producing side of a zth::Future.
+	 * \details The Future is shared between the Promise and all fibers that got it via #future().
+	 * \ingroup zth_api_cpp_sync
+	 */
+	template <typename T = void>
+	class Promise {
+	public:
+		typedef T type;
+		typedef Future<T> Future_type;
+
+		Promise(char const* name = "Promise") : m_future(new Future_type(name)) {}
+
+		SharedPointer<Future_type> const& future() const { return m_future; }
+
+		void set(type const& value) { m_future->set(value); }
+#if __cplusplus >= 201103L
+		void set(type&& value) { m_future->set(std::move(value)); }
+#endif
+
+	private:
+		SharedPointer<Future_type> m_future;
+	};
+
+	template <>
+	class Promise<void> {
+	public:
+		typedef void type;
+		typedef Future<void> Future_type;
+
+		Promise(char const* name = "Promise") : m_future(new Future_type(name)) {}
+
+		SharedPointer<Future_type> const& future() const { return m_future; }
+
+		void set() { m_future->set(); }
+
+	private:
+		SharedPointer<Future_type> m_future;
+	};
+
+	class Gate : public Synchronizer {
+	public:
+		Gate(size_t count, char const* name = "Gate")
+			: Synchronizer(name), m_count(count), m_current() {}
+		virtual ~Gate() {}
+
+		bool pass() {
+			zth_dbg(sync, "[%s] Pass", id_str());
+			if(++m_current >= count()) {
+				m_current -= count();
+				unblockAll();
+				return true;
+			} else {
+				return false;
+			}
+		}
+
+		void wait() {
+			if(!pass())
+				block();
+		}
+
+		/*!
+		 * \brief Like #wait(), but give up at \p timeout, or when cancelled.
+		 * \details When giving up, the pass is taken back.
+		 */
+		WaitResult waitUntil(Timestamp const& timeout) {
+			if(pass())
+				return Unblocked;
+
+			WaitResult res = block(timeout);
+			if(res != Unblocked)
+				m_current--;
+			return res;
+		}
+
+		WaitResult waitFor(TimeInterval const& timeout) { return waitUntil(Timestamp::now() + timeout); }
+
+		size_t count() const { return m_count; }
+		size_t current() const { return m_current; }
+
+	private:
+		size_t const m_count;
+		size_t m_current;
+	};
+
+	/*!
+	 * \brief The queue of the light synchronizers, such as zth::LightMutex.
+	 * \details Contrary to zth::Synchronizer, there are no virtual functions, reference count, ID or timeouts.
+	 *          Blocked fibers are linked via their own list node, so the queue is only two pointers,
+	 *          and an uncontended operation only touches the state of the synchronizer itself.
+	 *          Use these when many synchronizers are embedded in other objects.
+	 * \ingroup zth_api_cpp_sync
+	 */
+	class LightSynchronizer {
+	public:
+		bool waiting() const { return !m_queue.empty(); }
+
+	protected:
+		LightSynchronizer() {}
+		~LightSynchronizer() { zth_assert(m_queue.empty()); }
+
+		void block() {
+			Worker* w;
+			Fiber* f;
+			getContext(&w, &f);
+
+			zth_dbg(sync, "[%p] Block %s", this, f->id_str());
+			w->release(*f);
+			m_queue.push_back(*f);
+			f->nap(Timestamp::null());
+			w->schedule();
+		}
+
+		bool unblockFirst() {
+			if(likely(m_queue.empty()))
+				return false;
+
+			Worker* w;
+			getContext(&w, NULL);
+
+			Fiber& f = m_queue.front();
+			zth_dbg(sync, "[%p] Unblock %s", this, f.id_str());
+			m_queue.pop_front();
+			f.wakeup();
+			w->add(&f);
+			return true;
+		}
+
+		bool unblockAll() {
+			if(likely(m_queue.empty()))
+				return false;
+
+			while(unblockFirst());
+			return true;
+		}
+
+	private:
+		LightSynchronizer(LightSynchronizer const&);
+		LightSynchronizer& operator=(LightSynchronizer const&);
+
+		List<Fiber> m_queue;
+	};
+
+	/*!
+	 * \brief Like zth::Mutex, but based on zth::LightSynchronizer.
+	 * \ingroup zth_api_cpp_sync
+	 */
+	class LightMutex : public LightSynchronizer {
+	public:
+		LightMutex() : m_locked() {}
+
+		void lock() {
+			while(unlikely(m_locked))
+				block();
+			m_locked = true;
+		}
+
+		bool trylock() {
+			if(m_locked)
+				return false;
+			m_locked = true;
+			return true;
+		}
+
+		void unlock() {
+			zth_assert(m_locked);
+			m_locked = false;
+			unblockFirst();
+		}
+
+		bool locked() const { return m_locked; }
+
+	private:
+		bool m_locked;
+	};
+
+	/*!
+	 * \brief Like zth::Semaphore, but based on zth::LightSynchronizer.
+	 * \ingroup zth_api_cpp_sync
+	 */
+	class LightSemaphore : public LightSynchronizer {
+	public:
+		explicit LightSemaphore(size_t init = 0) : m_count(init) {}
+
+		void acquire() {
+			while(unlikely(!m_count))
+				block();
+			if(--m_count > 0)
+				// There might be another one waiting.
+				unblockFirst();
+		}
+
+		bool tryacquire() {
+			if(!m_count)
+				return false;
+			m_count--;
+			return true;
+		}
+
+		void release() {
+			zth_assert(m_count < std::numeric_limits<size_t>::max());
+			m_count++;
+			unblockFirst();
+		}
+
+		size_t value() const { return m_count; }
+
+	private:
+		size_t m_count;
+	};
+
+	/*!
+	 * \brief Like zth::Signal, but based on zth::LightSynchronizer.
+	 * \details A #signal() without a waiting fiber is remembered, such that the next #wait() returns immediately.
+	 * \ingroup zth_api_cpp_sync
+	 */
+	class LightSignal : public LightSynchronizer {
+	public:
+		LightSignal() : m_signalled() {}
+
+		void wait() {
+			if(m_signalled)
+				m_signalled = false;
+			else
+				block();
+		}
+
+		void signal() {
+			if(!unblockFirst())
+				m_signalled = true;
+		}
+
+		void signalAll() {
+			unblockAll();
+		}
+
+		void reset() { m_signalled = false; }
+
+	private:
+		bool m_signalled;
+	};
+
+	/*!
+	 * \brief Like zth::Future, but based on zth::LightSynchronizer.
+	 * \ingroup zth_api_cpp_sync
+	 */
+	template <typename T = void>
+	class LightFuture : public LightSynchronizer {
+	public:
+		typedef T type;
+
+		LightFuture() : m_valid() {}
+		~LightFuture() {
+			if(valid())
+				value().~type();
+		}
+
+		bool valid() const { return m_valid; }
+		operator bool() const { return valid(); }
+
+		void wait() { if(!valid()) block(); }
+
+		void set(type const& value = type()) {
+			zth_assert(!valid());
+			if(valid())
+				return;
+			new(m_data) type(value);
+			m_valid = true;
+			unblockAll();
+		}
+#if __cplusplus >= 201103L
+		void set(type&& value) {
+			zth_assert(!valid());
+			if(valid())
+				return;
+			new(m_data) type(std::move(value));
+			m_valid = true;
+			unblockAll();
+		}
+#endif
+
+		type& value() { wait(); char* p = m_data; return *reinterpret_cast<type*>(p); }
+		type const& value() const { const_cast<LightFuture*>(this)->wait(); char const* p = m_data; return *reinterpret_cast<type const*>(p); }
+
+	private:
+		char m_data[sizeof(type)] __attribute__((aligned(__alignof__(type))));
+		bool m_valid;
+	};
+
+	template <>
+	class LightFuture<void> : public LightSynchronizer {
+	public:
+		typedef void type;
+
+		LightFuture() : m_valid() {}
+
+		bool valid() const { return m_valid; }
+		operator bool() const { return valid(); }
+
+		void wait() { if(!valid()) block(); }
+
+		void set() {
+			zth_assert(!valid());
+			if(valid())
+				return;
+			m_valid = true;
+			unblockAll();
+		}
+
+	private:
+		bool m_valid;
+	};
+
+	namespace impl {
+		ZTH_EXPORT int waitOnAddress(void const volatile* addr, Timestamp const& deadline);
+	}
+
+	/*!
+	 * \brief Blocks the current fiber, as long as \p *addr equals \p expected, till #wakeAddress() is called for \p addr.
+	 * \details This is the fiber equivalent of a futex: the fibers are parked in a hash table of the Worker,
+	 *          so the object at \p addr does not need an embedded synchronizer.
+	 *          As fibers are not preempted, nobody can change \p *addr between the check and blocking.
+	 *          Only fibers of the same Worker can be woken up.
+	 * \param addr the address to wait for
+	 * \param expected the value of \p *addr to block on
+	 * \param deadline the time to give up, or Timestamp::null() to wait forever
+	 * \return 0 when woken up, \c EAGAIN when \p *addr does not equal \p expected, or \c ETIMEDOUT
+	 * \ingroup zth_api_cpp_sync
+	 */
+	template <typename T, typename E>
+	int waitOnAddress(T const volatile* addr, E const& expected, Timestamp const& deadline = Timestamp::null()) {
+		if(*addr != expected)
+			return EAGAIN;
+		return impl::waitOnAddress(addr, deadline);
+	}
+
+	/*!
+	 * \brief Like #waitOnAddress(T const volatile*, E const&, Timestamp const&), but with a relative timeout.
+	 * \ingroup zth_api_cpp_sync
+	 */
+	template <typename T, typename E>
+	int waitOnAddress(T const volatile* addr, E const& expected, TimeInterval const& timeout) {
+		return waitOnAddress(addr, expected, Timestamp::now() + timeout);
+	}
+
+	/*!
+	 * \brief Wakes up at most \p n fibers (of the current Worker) in #waitOnAddress() for \p addr, in FIFO order.
+	 * \return the number of fibers woken up
+	 * \ingroup zth_api_cpp_sync
+	 */
+	ZTH_EXPORT size_t wakeAddress(void const volatile* addr, size_t n = 1);
+
+	/*!
+	 * \brief Wakes up all fibers (of the current Worker) in #waitOnAddress() for \p addr.
+	 * \return the number of fibers woken up
+	 * \ingroup zth_api_cpp_sync
+	 */
+	ZTH_EXPORT inline size_t wakeAddressAll(void const volatile* addr) {
+		return wakeAddress(addr, std::numeric_limits<size_t>::max());
+	}
+
+	namespace impl {
+#if __cplusplus >= 201103L
+		template <typename T> inline T&& channelMove(T& x) { return std::move(x); }
+#else
+		template <typename T> inline T& channelMove(T& x) { return x; }
+#endif
+
+		/*!
+		 * \brief A fiber that waits in one or more channels.
+		 * \details The fiber is woken up by the first channel that completes its operation;
+		 *          its nodes in other channels are ignored from then on.
+		 */
+		struct ChannelWait {
+			explicit ChannelWait(Fiber& fiber, void* slot)
+				: fiber(fiber), slot(slot), alarm(), ready(-1), done() {}
+
+			Fiber& fiber;
+			// The value to be sent, or the storage for the value to be received.
+			void* slot;
+			TimedWaitable* alarm;
+			// The index of the channel that completed, or -1.
+			int ready;
+			bool done;
+		};
+
+		class ChannelAlarm : public TimedWaitable {
+		public:
+			ChannelAlarm(ChannelWait& wait, Timestamp const& timeout)
+				: TimedWaitable(timeout), m_wait(wait) { setFiber(wait.fiber); }
+			virtual ~ChannelAlarm() {}
+
+			virtual bool poll(Timestamp const& now = Timestamp::now()) {
+				if(!TimedWaitable::poll(now))
+					return false;
+				// The Waiter wakes up the fiber.
+				m_wait.done = true;
+				return true;
+			}
+		private:
+			ChannelWait& m_wait;
+		};
+
+		/*!
+		 * \brief Suspends the current fiber, until #channelWake() or \p timeout.
+		 */
+		inline void channelSleep(ChannelWait& wait, Timestamp const& timeout) {
+			Worker* w;
+			getContext(&w, NULL);
+
+			ChannelAlarm alarm(wait, timeout);
+			w->release(wait.fiber);
+			wait.fiber.nap(Timestamp::null());
+			if(!timeout.isNull()) {
+				wait.alarm = &alarm;
+				w->waiter().scheduleTask(alarm);
+			}
+			w->schedule();
+		}
+
+		inline void channelWake(ChannelWait& wait, int ready) {
+			zth_assert(!wait.done);
+			Worker* w;
+			getContext(&w, NULL);
+
+			wait.ready = ready;
+			wait.done = true;
+			if(wait.alarm) {
+				w->waiter().unscheduleTask(*wait.alarm);
+				wait.alarm = NULL;
+			}
+
+			wait.fiber.wakeup();
+			w->add(&wait.fiber);
+		}
+
+		/*!
+		 * \brief Wakes up the fiber in zth::whenAny() when its Future is set.
+		 */
+		class WhenAnyCallback : public FutureCallback {
+		public:
+			WhenAnyCallback() : m_wait(), m_index() {}
+			virtual ~WhenAnyCallback() {}
+
+			void init(ChannelWait& wait, int index) { m_wait = &wait; m_index = index; }
+
+			virtual void ready(FutureBase& UNUSED_PAR(future)) {
+				if(!m_wait->done)
+					channelWake(*m_wait, m_index);
+			}
+
+		private:
+			ChannelWait* m_wait;
+			int m_index;
+		};
+	} // namespace impl
+
+	/*!
+	 * \brief Waits till all \p futures are valid.
+	 * \ingroup zth_api_cpp_sync
+	 */
+	inline Synchronizer::WaitResult whenAll(FutureBase* const* futures, size_t count, Timestamp const& timeout = Timestamp::null()) {
+		for(size_t i = 0; i < count; i++) {
+			Synchronizer::WaitResult res = futures[i]->waitUntil(timeout);
+			if(res != Synchronizer::Unblocked)
+				return res;
+		}
+		return Synchronizer::Unblocked;
+	}
+
+	/*!
+	 * \brief Waits till any of the \p futures is valid.
+	 * \details The fiber waits for all \p futures at the same time, without allocating memory or other fibers.
+	 * \return the index of a valid Future, or -1 when \p timeout has passed
+	 * \ingroup zth_api_cpp_sync
+	 */
+	template <size_t N>
+	int whenAny(FutureBase* const (&futures)[N], Timestamp const& timeout = Timestamp::null()) {
+		for(size_t i = 0; i < N; i++)
+			if(futures[i]->valid())
+				return (int)i;
+
+		if(!timeout.isNull() && timeout <= Timestamp::now())
+			return -1;
+
+		impl::ChannelWait wait(currentFiber(), NULL);
+		impl::WhenAnyCallback callbacks[N];
+		for(size_t i = 0; i < N; i++) {
+			callbacks[i].init(wait, (int)i);
+			futures[i]->then(callbacks[i]);
+		}
+
+		impl::channelSleep(wait, timeout);
+
+		for(size_t i = 0; i < N; i++)
+			futures[i]->forget(callbacks[i]);
+		return wait.ready;
+	}
+
+	/*!
+	 * \brief Waits for any of up to \p N Synchronizers and fds at the same time, optionally with a timeout.
+	 * \details Add everything to wait for by #add(), which returns its index, and then call #wait() once.
+	 *          A Synchronizer fires when it unblocks the fiber, like Signal::signal(), Future::set() or Mutex::unlock() do.
+	 *          A Signal that is queued already or a Future that is valid already fires right away.
+	 *          Check or take the Synchronizer after it fired, as another fiber may be woken up too (e.g. by a Mutex).
+	 *          When returning, the fiber is removed from all other Synchronizers, and the fds are not polled anymore.
+	 *          All fds of all added AwaitFds count for \p N as well.
+	 * \ingroup zth_api_cpp_sync
+	 */
+	template <size_t N>
+	class WaitAny {
+	public:
+		WaitAny() : m_count(), m_ready(-1) {
+#ifdef ZTH_HAVE_POLLER
+			m_nfds = 0;
+#endif
+		}
+
+		int add(Synchronizer& synchronizer) {
+			zth_assert(m_count < N);
+			if(unlikely(m_count >= N))
+				return -1;
+
+			m_entries[m_count].synchronizer = &synchronizer;
+#ifdef ZTH_HAVE_POLLER
+			m_entries[m_count].fds = NULL;
+#endif
+			return (int)m_count++;
+		}
+
+		int add(FutureBase& future) {
+			int index = add(static_cast<Synchronizer&>(future));
+			if(index >= 0 && m_ready < 0 && future.valid())
+				m_ready = index;
+			return index;
+		}
+
+		int add(Signal& signal) {
+			int index = add(static_cast<Synchronizer&>(signal));
+			if(index >= 0 && m_ready < 0 && signal.trywait())
+				m_ready = index;
+			return index;
+		}
+
+#ifdef ZTH_HAVE_POLLER
+		/*!
+		 * \brief Adds the fds of \p w; their \c revents and AwaitFd::result() are set when #wait() returns.
+		 * \details The timeout of \p w is ignored; pass it to #wait() instead.
+		 */
+		int add(AwaitFd& w) {
+			zth_assert(m_count < N && m_nfds + (size_t)w.nfds() <= N);
+			if(unlikely(m_count >= N || m_nfds + (size_t)w.nfds() > N))
+				return -1;
+
+			for(int i = 0; i < w.nfds(); i++) {
+				m_fds[m_nfds] = w.fds()[i];
+				m_fdEntry[m_nfds] = (int)m_count;
+				m_nfds++;
+			}
+
+			m_entries[m_count].synchronizer = NULL;
+			m_entries[m_count].fds = &w;
+			return (int)m_count++;
+		}
+#endif
+
+		/*!
+		 * \brief Waits till one of the added Synchronizers or fds fires.
+		 * \return the index of the one that fired, or -1 with \c errno set to \c ETIMEDOUT when \p timeout has passed, or another error
+		 */
+		int wait(Timestamp const& timeout = Timestamp::null()) {
+			if(m_ready >= 0)
+				return m_ready;
+
+			if(!timeout.isNull() && timeout <= Timestamp::now()) {
+				errno = ETIMEDOUT;
+				return -1;
+			}
+
+			Worker* w;
+			Fiber* f;
+			getContext(&w, &f);
+
+			impl::AnyWait any(*f);
+			impl::AnyAlarm alarm(any, timeout);
+
+#ifdef ZTH_HAVE_POLLER
+			// Only registered when there are fds.
+			AwaitFd fdWait(m_fds, m_nfds > 0 ? (int)m_nfds : 1, timeout);
+			if(m_nfds > 0) {
+				int res = w->waiter().addFd(fdWait);
+				if(res) {
+					errno = res;
+					return -1;
+				}
+				any.fds = &fdWait;
+			} else
+#endif
+			if(!timeout.isNull())
+				any.alarm = &alarm;
+
+			char nodes[N][sizeof(Synchronizer::Blocked)] __attribute__((aligned(sizeof(void*))));
+			for(size_t i = 0; i < m_count; i++) {
+				Synchronizer* s = m_entries[i].synchronizer;
+				if(!s)
+					continue;
+
+				Synchronizer::Blocked* b = new(nodes[i]) Synchronizer::Blocked(*f);
+				b->any = &any;
+				b->index = (int)i;
+				s->enqueue(*b);
+			}
 
-		void release(size_t count = 1) {
-			zth_assert(m_count + count >= m_count); // ...otherwise it wrapped around, which is probably not want you wanted...
+			w->release(*f);
+			f->nap(Timestamp::null());
+			if(any.alarm)
+				w->waiter().scheduleTask(alarm);
+			w->schedule();
 
-			if(unlikely(m_count + count < m_count))
-				// wrapped around, saturate
-				m_count = std::numeric_limits<size_t>::max();
-			else
-				m_count += count;
-			
-			zth_dbg(sync, "[%s] Released %zu", id_str(), count);
+			for(size_t i = 0; i < m_count; i++) {
+				Synchronizer* s = m_entries[i].synchronizer;
+				if(!s)
+					continue;
 
-			if(likely(m_count > 0))
-				unblockFirst();
+				Synchronizer::Blocked* b = reinterpret_cast<Synchronizer::Blocked*>(nodes[i]);
+				s->dequeue(*b);
+				b->~Blocked();
+			}
+
+			if(any.alarm)
+				w->waiter().unscheduleTask(alarm);
+
+			int fired = any.fired;
+			int error = 0;
+#ifdef ZTH_HAVE_POLLER
+			if(m_nfds > 0) {
+				error = w->waiter().removeFd(fdWait);
+
+				// Pass the revents back to the AwaitFds that were added.
+				size_t i = 0;
+				while(i < m_nfds) {
+					int entry = m_fdEntry[i];
+					AwaitFd& fds = *m_entries[entry].fds;
+					int ready = 0;
+					for(int j = 0; j < fds.nfds(); j++, i++) {
+						fds.fds()[j].revents = m_fds[i].revents;
+						if(m_fds[i].revents)
+							ready++;
+					}
+					fds.setResult(ready, error);
+					if(ready && fired < 0)
+						fired = entry;
+				}
+			}
+#endif
+
+			if(fired >= 0)
+				return fired;
+
+			errno = error ? error : ETIMEDOUT;
+			return -1;
 		}
 
-		size_t value() const { return m_count; }
+		int wait(TimeInterval const& timeout) { return wait(Timestamp::now() + timeout); }
 
 	private:
+		struct Entry {
+			Synchronizer* synchronizer;
+#ifdef ZTH_HAVE_POLLER
+			AwaitFd* fds;
+#endif
+		};
+
+		Entry m_entries[N];
 		size_t m_count;
+		int m_ready;
+#ifdef ZTH_HAVE_POLLER
+		zth_pollfd_t m_fds[N];
+		int m_fdEntry[N];
+		size_t m_nfds;
+#endif
 	};
 
+#if __cplusplus >= 201103L
 	/*!
+	 * \brief Waits for any of \p a, which are Synchronizers or AwaitFds, or till \p timeout.
+	 * \return the index in \p a that fired, or -1 with \c errno set
+	 * \see zth::WaitAny
 	 * \ingroup zth_api_cpp_sync
 	 */
-	class Signal : public Synchronizer {
+	template <typename... A>
+	int waitAny(Timestamp const& timeout, A&... a) {
+		WaitAny<sizeof...(A)> any;
+		int dummy[] = { any.add(a)... };
+		(void)dummy;
+		return any.wait(timeout);
+	}
+
+	/*!
+	 * \copydoc zth::waitAny(Timestamp const&, A&...)
+	 * \ingroup zth_api_cpp_sync
+	 */
+	template <typename... A>
+	int waitAny(TimeInterval const& timeout, A&... a) {
+		return waitAny(Timestamp::now() + timeout, a...);
+	}
+
+	/*!
+	 * \copydoc zth::whenAll(FutureBase* const*, size_t, Timestamp const&)
+	 * \ingroup zth_api_cpp_sync
+	 */
+	template <typename... F>
+	Synchronizer::WaitResult whenAll(FutureBase& future, F&... futures) {
+		FutureBase* const f[] = { &future, &futures... };
+		return whenAll(f, sizeof(f) / sizeof(f[0]));
+	}
+
+	/*!
+	 * \copydoc zth::whenAny(FutureBase* const (&)[N], Timestamp const&)
+	 * \ingroup zth_api_cpp_sync
+	 */
+	template <typename... F>
+	int whenAny(FutureBase& future, F&... futures) {
+		FutureBase* const f[] = { &future, &futures... };
+		return whenAny(f);
+	}
+#endif
+
+	/*!
+	 * \brief A bounded queue of values, which are passed between fibers.
+	 * \details #push() blocks when the channel is full, #pop() blocks when it is empty.
+	 *          When a fiber is waiting on the other side, the value is passed to it directly.
+	 *          Values are moved in and out, when compiled for C++11.
+	 *          With a capacity of 0, every #push() waits for a #pop(), and vice versa.
+	 *
+	 *          After #close(), #push() fails, and #pop() fails when the channel is empty.
+	 *
+	 *          A Channel keeps its own queues of senders and receivers, so it is not a zth::Synchronizer.
+	 * \ingroup zth_api_cpp_sync
+	 */
+	template <typename T>
+	class Channel : public RefCounted, public UniqueID<Channel<T> > {
 	public:
-		Signal(char const* name = "Signal") : Synchronizer(name) , m_signalled() {}
-		virtual ~Signal() {}
+		typedef T type;
 
-		void wait() {
-			if(!m_signalled)
-				block();
-			else
-				// Do a yield() here, as one might rely on the signal to block
-				// regularly when the signal is used in a loop (see daemon
-				// pattern).
-				yield();
+		explicit Channel(size_t capacity = 1, char const* name = "Channel")
+			: RefCounted()
+			, UniqueID<Channel<T> >(Config::NamedSynchronizer ? name : NULL)
+			, m_buffer(capacity ? static_cast<type*>(::operator new(capacity * sizeof(type))) : NULL)
+			, m_capacity(capacity)
+			, m_head()
+			, m_count()
+			, m_closed()
+		{}
+
+		virtual ~Channel() {
+			zth_assert(m_senders.empty());
+			zth_assert(m_receivers.empty());
+			for(; m_count > 0; m_count--) {
+				at(m_head).~type();
+				m_head = next(m_head);
+			}
+			::operator delete(m_buffer);
+		}
 
-			if(m_signalled > 0)
-				m_signalled--;
+		size_t capacity() const { return m_capacity; }
+		size_t size() const { return m_count; }
+		bool empty() const { return m_count == 0; }
+		bool full() const { return m_count == m_capacity; }
+		bool closed() const { return m_closed; }
+
+		/*!
+		 * \brief Adds \p value to the channel, and waits for space when it is full.
+		 * \return \c true when added, \c false when the channel is closed
+		 */
+		bool push(type const& value) {
+			type v(value);
+			return push_(v, Timestamp::null());
 		}
 
-		void signal(bool queue = true, bool queueEveryTime = false) {
-			zth_dbg(sync, "[%s] Signal", id_str());
-			if(!unblockFirst() && queue && m_signalled >= 0) {
-				if(m_signalled == 0 || queueEveryTime)
-					m_signalled++;
-				zth_assert(m_signalled > 0); // Otherwise, it wrapped around, which is probably not what you want.
-			}
+#if __cplusplus >= 201103L
+		/*!
+		 * \copydoc push(type const&)
+		 */
+		bool push(type&& value) {
+			return push_(value, Timestamp::null());
 		}
+#endif
 
-		void signalAll(bool queue = true) {
-			zth_dbg(sync, "[%s] Signal all", id_str());
-			unblockAll();
-			if(queue)
-				m_signalled = -1;
+		/*!
+		 * \brief Adds \p value to the channel, only when that can be done without waiting.
+		 */
+		bool trypush(type const& value) {
+			if(m_closed || (!waiting(m_receivers) && full()))
+				return false;
+			return push(value);
 		}
 
-		void reset() {
-			m_signalled = 0;
+		/*!
+		 * \brief Moves \p count values into the channel, and waits for space when needed.
+		 * \return the number of values that were added, which is less than \p count when the channel was closed
+		 */
+		size_t push_n(type* values, size_t count) {
+			for(size_t i = 0; i < count; i++)
+				if(!push_(values[i], Timestamp::null()))
+					return i;
+			return count;
 		}
 
-	private:
-		int m_signalled;
-	};
+		/*!
+		 * \brief Moves the oldest value out of the channel into \p value, and waits for one when it is empty.
+		 * \return \c true when a value was received, \c false when the channel is closed and empty
+		 */
+		bool pop(type& value) {
+			return pop_(value, Timestamp::null());
+		}
 
-	/*!
-	 * \ingroup zth_api_cpp_sync
-	 */
-	template <typename T = void>
-	class Future : public Synchronizer {
-	public:
-		typedef T type;
-		Future(char const* name = "Future") : Synchronizer(name), m_valid() {
-#ifdef ZTH_USE_VALGRIND
-			VALGRIND_MAKE_MEM_NOACCESS(m_data, sizeof(m_data));
-#endif
+		/*!
+		 * \brief Like #pop(), but only when that can be done without waiting.
+		 */
+		bool trypop(type& value) {
+			if(empty() && !waiting(m_senders))
+				return false;
+			return pop(value);
 		}
-		virtual ~Future() {
-			if(valid())
-				value().~type();
-#ifdef ZTH_USE_VALGRIND
-			VALGRIND_MAKE_MEM_UNDEFINED(m_data, sizeof(m_data));
-#endif
+
+		/*!
+		 * \brief Waits for at least one value, and then moves as many values as available, up to \p count.
+		 * \return the number of values received, which is 0 when the channel is closed and empty
+		 */
+		size_t pop_n(type* values, size_t count) {
+			if(!count || !pop_(values[0], Timestamp::null()))
+				return 0;
+
+			size_t i = 1;
+			while(i < count && trypop(values[i]))
+				i++;
+			return i;
 		}
 
-		bool valid() const { return m_valid; }
-		operator bool() const { return valid(); }
+		/*!
+		 * \brief Closes the channel, and wakes up all fibers that wait for it.
+		 */
+		void close() {
+			zth_dbg(sync, "[%s] Close", this->id_str());
+			m_closed = true;
+			wakeAll(m_senders);
+			wakeAll(m_receivers);
+		}
 
-		void wait() { if(!valid()) block(); }
-		void set(type const& value = type()) {
-			zth_assert(!valid());
-			if(valid())
-				return;
-#ifdef ZTH_USE_VALGRIND
-			VALGRIND_MAKE_MEM_UNDEFINED(m_data, sizeof(m_data));
-#endif
-			new(m_data) type(value);
-			m_valid = true;
-			zth_dbg(sync, "[%s] Set", id_str());
-			unblockAll();
+		/*!
+		 * \brief Receives a value from the first of \p channels that has one.
+		 * \param timeout when not null, give up at this time
+		 * \return the index of the channel in \p channels, or -1 when all channels are closed and empty,
+		 *         or the timeout has passed
+		 */
+		template <size_t N>
+		static int select(Channel* const (&channels)[N], type& value, Timestamp const& timeout = Timestamp::null()) {
+			Node nodes[N];
+			return select_(channels, nodes, N, value, timeout);
 		}
-		Future& operator=(type const& value) { set(value); return *this; }
 
-		type& value() { wait(); char* p = m_data; return *reinterpret_cast<type*>(p); }
-		type const& value() const { wait(); char const* p = m_data; return *reinterpret_cast<type const*>(p); }
-		operator type const&() const { return value(); }
-		operator type&() { return value(); }
-		type const* operator*() const { return &value(); }
-		type* operator*() { return &value(); }
-		type const* operator->() const { return &value(); }
-		type* operator->() { return &value(); }
-	private:
-		char m_data[sizeof(type)] __attribute__((aligned(8)));
-		bool m_valid;
-	};
-	
-	template <>
-	class Future<void> : public Synchronizer {
-	public:
-		typedef void type;
-		Future(char const* name = "Future") : Synchronizer(name), m_valid() {}
-		virtual ~Future() {}
+	protected:
+		struct Node : public Listable<Node> {
+			Node() : wait(), index(), queued() {}
+			explicit Node(impl::ChannelWait& wait) : wait(&wait), index(), queued() {}
+			impl::ChannelWait* wait;
+			int index;
+			bool queued;
+		};
+
+		static int select_(Channel* const* channels, Node* nodes, size_t count, type& value, Timestamp const& timeout) {
+			while(true) {
+				bool open = false;
+				for(size_t i = 0; i < count; i++) {
+					if(channels[i]->trypop(value))
+						return (int)i;
+					open = open || !channels[i]->closed();
+				}
 
-		bool valid() const { return m_valid; }
-		operator bool() const { return valid(); }
+				if(!open || (!timeout.isNull() && timeout <= Timestamp::now()))
+					return -1;
 
-		void wait() { if(!valid()) block(); }
-		void set() {
-			zth_assert(!valid());
-			if(valid())
-				return;
-			m_valid = true;
-			zth_dbg(sync, "[%s] Set", id_str());
-			unblockAll();
+				char slot[sizeof(type)] __attribute__((aligned(__alignof__(type))));
+				impl::ChannelWait wait(currentFiber(), slot);
+				for(size_t i = 0; i < count; i++) {
+					nodes[i].wait = &wait;
+					nodes[i].index = (int)i;
+					if(!channels[i]->closed())
+						channels[i]->enqueue(channels[i]->m_receivers, nodes[i]);
+				}
+
+				impl::channelSleep(wait, timeout);
+
+				for(size_t i = 0; i < count; i++)
+					if(nodes[i].queued)
+						channels[i]->dequeue(channels[i]->m_receivers, nodes[i]);
+
+				if(wait.ready >= 0) {
+					type* v = reinterpret_cast<type*>(slot);
+					value = impl::channelMove(*v);
+					v->~type();
+					return wait.ready;
+				}
+			}
 		}
 
-	private:
-		bool m_valid;
-	};
+		type& at(size_t i) { return m_buffer[i]; }
+		size_t next(size_t i) const { return i + 1 < m_capacity ? i + 1 : 0; }
 
-	class Gate : public Synchronizer {
-	public:
-		Gate(size_t count, char const* name = "Gate")
-			: Synchronizer(name), m_count(count), m_current() {}
-		virtual ~Gate() {}
+		void enqueue(List<Node>& queue, Node& node) {
+			queue.push_back(node);
+			node.queued = true;
+		}
 
-		bool pass() {
-			zth_dbg(sync, "[%s] Pass", id_str());
-			if(++m_current >= count()) {
-				m_current -= count();
-				unblockAll();
-				return true;
-			} else {
-				return false;
+		void dequeue(List<Node>& queue, Node& node) {
+			queue.erase(node);
+			node.queued = false;
+		}
+
+		/*!
+		 * \brief Removes the first node of \p queue that is still waiting, if any.
+		 */
+		Node* first(List<Node>& queue) {
+			while(!queue.empty()) {
+				Node& node = queue.front();
+				dequeue(queue, node);
+				if(!node.wait->done)
+					return &node;
 			}
+			return NULL;
 		}
 
-		void wait() {
-			if(!pass())
-				block();
+		/*!
+		 * \brief Checks if a fiber is waiting in \p queue.
+		 */
+		bool waiting(List<Node>& queue) {
+			while(!queue.empty() && queue.front().wait->done)
+				dequeue(queue, queue.front());
+			return !queue.empty();
 		}
 
-		size_t count() const { return m_count; }
-		size_t current() const { return m_current; }
+		void wakeAll(List<Node>& queue) {
+			while(Node* node = first(queue))
+				impl::channelWake(*node->wait, -1);
+		}
+
+		bool push_(type& value, Timestamp const& timeout) {
+			while(!m_closed) {
+				if(Node* receiver = first(m_receivers)) {
+					// Hand off.
+					new(receiver->wait->slot) type(impl::channelMove(value));
+					impl::channelWake(*receiver->wait, receiver->index);
+					return true;
+				}
+
+				if(!full()) {
+					new(&at((m_head + m_count) % m_capacity)) type(impl::channelMove(value));
+					m_count++;
+					return true;
+				}
+
+				if(!timeout.isNull() && timeout <= Timestamp::now())
+					return false;
+
+				impl::ChannelWait wait(currentFiber(), &value);
+				Node node(wait);
+				enqueue(m_senders, node);
+				impl::channelSleep(wait, timeout);
+				if(node.queued)
+					dequeue(m_senders, node);
+
+				if(wait.ready >= 0)
+					// A receiver took our value.
+					return true;
+			}
+
+			return false;
+		}
+
+		bool pop_(type& value, Timestamp const& timeout) {
+			while(true) {
+				if(m_count) {
+					value = impl::channelMove(at(m_head));
+					at(m_head).~type();
+					m_head = next(m_head);
+					m_count--;
+
+					if(Node* sender = first(m_senders)) {
+						// Take the value of a waiting sender into the freed space.
+						new(&at((m_head + m_count) % m_capacity)) type(impl::channelMove(*static_cast<type*>(sender->wait->slot)));
+						m_count++;
+						impl::channelWake(*sender->wait, 0);
+					}
+					return true;
+				}
+
+				if(Node* sender = first(m_senders)) {
+					// Rendezvous with a sender of an unbuffered channel.
+					value = impl::channelMove(*static_cast<type*>(sender->wait->slot));
+					impl::channelWake(*sender->wait, 0);
+					return true;
+				}
+
+				if(m_closed || (!timeout.isNull() && timeout <= Timestamp::now()))
+					return false;
+
+				char slot[sizeof(type)] __attribute__((aligned(__alignof__(type))));
+				impl::ChannelWait wait(currentFiber(), slot);
+				Node node(wait);
+				enqueue(m_receivers, node);
+				impl::channelSleep(wait, timeout);
+				if(node.queued)
+					dequeue(m_receivers, node);
+
+				if(wait.ready >= 0) {
+					type* v = reinterpret_cast<type*>(slot);
+					value = impl::channelMove(*v);
+					v->~type();
+					return true;
+				}
+			}
+		}
 
 	private:
-		size_t const m_count;
-		size_t m_current;
+		type* m_buffer;
+		size_t const m_capacity;
+		size_t m_head;
+		size_t m_count;
+		bool m_closed;
+		List<Node> m_senders;
+		List<Node> m_receivers;
 	};
 
 } // namespace
@@ -456,6 +2121,105 @@ EXTERN_C ZTH_EXPORT ZTH_INLINE int zth_mutex_unlock(zth_mutex_t* mutex) {
 	return 0;
 }
 
+struct zth_rwlock_t { void* p; };
+
+/*!
+ * \brief Initializes a reader-writer lock.
+ * \details This is a C-wrapper to create a new zth::SharedMutex.
+ * \ingroup zth_api_c_sync
+ */
+EXTERN_C ZTH_EXPORT ZTH_INLINE int zth_rwlock_init(zth_rwlock_t* rwlock, int preferWriter) {
+	if(unlikely(!rwlock))
+		return EINVAL;
+
+	rwlock->p = (void*)new zth::SharedMutex(preferWriter != 0);
+	return 0;
+}
+
+/*!
+ * \brief Destroys a reader-writer lock.
+ * \details This is a C-wrapper to delete a zth::SharedMutex.
+ * \ingroup zth_api_c_sync
+ */
+EXTERN_C ZTH_EXPORT ZTH_INLINE int zth_rwlock_destroy(zth_rwlock_t* rwlock) {
+	if(unlikely(!rwlock))
+		return EINVAL;
+	if(unlikely(!rwlock->p))
+		// Already destroyed.
+		return 0;
+
+	delete reinterpret_cast<zth::SharedMutex*>(rwlock->p);
+	rwlock->p = NULL;
+	return 0;
+}
+
+/*!
+ * \brief Locks a reader-writer lock for reading.
+ * \details This is a C-wrapper for zth::SharedMutex::lockShared().
+ * \ingroup zth_api_c_sync
+ */
+EXTERN_C ZTH_EXPORT ZTH_INLINE int zth_rwlock_rdlock(zth_rwlock_t* rwlock) {
+	if(unlikely(!rwlock || !rwlock->p))
+		return EINVAL;
+
+	reinterpret_cast<zth::SharedMutex*>(rwlock->p)->lockShared();
+	return 0;
+}
+
+/*!
+ * \brief Try to lock a reader-writer lock for reading.
+ * \details This is a C-wrapper for zth::SharedMutex::trylockShared().
+ * \ingroup zth_api_c_sync
+ */
+EXTERN_C ZTH_EXPORT ZTH_INLINE int zth_rwlock_tryrdlock(zth_rwlock_t* rwlock) {
+	if(unlikely(!rwlock || !rwlock->p))
+		return EINVAL;
+
+	return reinterpret_cast<zth::SharedMutex*>(rwlock->p)->trylockShared() ? 0 : EBUSY;
+}
+
+/*!
+ * \brief Locks a reader-writer lock for writing.
+ * \details This is a C-wrapper for zth::SharedMutex::lock().
+ * \ingroup zth_api_c_sync
+ */
+EXTERN_C ZTH_EXPORT ZTH_INLINE int zth_rwlock_wrlock(zth_rwlock_t* rwlock) {
+	if(unlikely(!rwlock || !rwlock->p))
+		return EINVAL;
+
+	reinterpret_cast<zth::SharedMutex*>(rwlock->p)->lock();
+	return 0;
+}
+
+/*!
+ * \brief Try to lock a reader-writer lock for writing.
+ * \details This is a C-wrapper for zth::SharedMutex::trylock().
+ * \ingroup zth_api_c_sync
+ */
+EXTERN_C ZTH_EXPORT ZTH_INLINE int zth_rwlock_trywrlock(zth_rwlock_t* rwlock) {
+	if(unlikely(!rwlock || !rwlock->p))
+		return EINVAL;
+
+	return reinterpret_cast<zth::SharedMutex*>(rwlock->p)->trylock() ? 0 : EBUSY;
+}
+
+/*!
+ * \brief Unlock a reader-writer lock, which was locked for either reading or writing.
+ * \details This is a C-wrapper for zth::SharedMutex::unlock() and zth::SharedMutex::unlockShared().
+ * \ingroup zth_api_c_sync
+ */
+EXTERN_C ZTH_EXPORT ZTH_INLINE int zth_rwlock_unlock(zth_rwlock_t* rwlock) {
+	if(unlikely(!rwlock || !rwlock->p))
+		return EINVAL;
+
+	zth::SharedMutex* m = reinterpret_cast<zth::SharedMutex*>(rwlock->p);
+	if(m->locked())
+		m->unlock();
+	else
+		m->unlockShared();
+	return 0;
+}
+
 struct zth_sem_t { void* p; };
 
 /*!
@@ -778,6 +2542,15 @@ ZTH_EXPORT int zth_mutex_lock(zth_mutex_t* mutex);
 ZTH_EXPORT int zth_mutex_trylock(zth_mutex_t* mutex);
 ZTH_EXPORT int zth_mutex_unlock(zth_mutex_t* mutex);
 
+typedef struct { void* p; } zth_rwlock_t;
+ZTH_EXPORT int zth_rwlock_init(zth_rwlock_t* rwlock, int preferWriter);
+ZTH_EXPORT int zth_rwlock_destroy(zth_rwlock_t* rwlock);
+ZTH_EXPORT int zth_rwlock_rdlock(zth_rwlock_t* rwlock);
+ZTH_EXPORT int zth_rwlock_tryrdlock(zth_rwlock_t* rwlock);
+ZTH_EXPORT int zth_rwlock_wrlock(zth_rwlock_t* rwlock);
+ZTH_EXPORT int zth_rwlock_trywrlock(zth_rwlock_t* rwlock);
+ZTH_EXPORT int zth_rwlock_unlock(zth_rwlock_t* rwlock);
+
 typedef struct { void* p; } zth_sem_t;
 ZTH_EXPORT int zth_sem_init(zth_sem_t* sem, size_t value);
 ZTH_EXPORT int zth_sem_destroy(zth_sem_t* sem);
@@ -112,6 +112,7 @@ namespace zth {
 		}
 
 		TimeInterval(TimeInterval const& t) : m_t(t.ts()), m_negative(t.isNegative()) {}
+		TimeInterval& operator=(TimeInterval const& t) { m_t = t.ts(); m_negative = t.isNegative(); return *this; }
 
 		constexpr bool isNormal() const { return m_t.tv_sec >= 0 && m_t.tv_nsec >= 0 && m_t.tv_nsec < BILLION; }
 		constexpr bool isNegative() const { return m_negative; }
@@ -18,6 +18,12 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <libzth/macros.h>
+
+#ifdef ZTH_HAVE_SIGNALFD
+#  include <signal.h>
+#endif
+
 #ifdef __cplusplus
 
 #include <libzth/fiber.h>
@@ -45,6 +51,53 @@
 namespace zth {
 	class Worker;
 
+#ifdef ZTH_HAVE_EPOLL
+	namespace impl {
+		/*!
+		 * \brief Converts the \c POLL* flags of a #zth_pollfd_t to \c EPOLL* flags.
+		 * \details With ZeroMQ, the \c POLL* flags are redefined above, and do not match the \c EPOLL* ones.
+		 */
+		inline uint32_t toEpoll(short events) {
+			uint32_t res = 0;
+			if(events & POLLIN)
+				res |= EPOLLIN;
+			if(events & POLLOUT)
+				res |= EPOLLOUT;
+#  ifdef POLLPRI
+			if(events & POLLPRI)
+				res |= EPOLLPRI;
+#  endif
+			return res;
+		}
+
+		/*!
+		 * \brief Converts \c EPOLL* flags to the \c POLL* flags of a #zth_pollfd_t.
+		 */
+		inline short fromEpoll(uint32_t events) {
+			short res = 0;
+			if(events & EPOLLIN)
+				res |= POLLIN;
+			if(events & EPOLLOUT)
+				res |= POLLOUT;
+			if(events & EPOLLERR)
+				res |= POLLERR;
+#  ifdef POLLPRI
+			if(events & EPOLLPRI)
+				res |= POLLPRI;
+#  endif
+#  ifdef POLLHUP
+			if(events & EPOLLHUP)
+				res |= POLLHUP;
+#  else
+			if(events & EPOLLHUP)
+				// A hangup makes a read() return end-of-file.
+				res |= POLLIN;
+#  endif
+			return res;
+		}
+	} // namespace impl
+#endif
+
 	class Waitable {
 	public:
 		Waitable() : m_fiber() {}
@@ -174,12 +227,23 @@ namespace zth {
 	};
 #endif
 
+	namespace impl {
+		/*!
+		 * \brief A fiber in Waiter::waitNotify(), which lives on the stack of that fiber.
+		 */
+		struct NotifyWait : public Listable<NotifyWait> {
+			NotifyWait(Fiber& fiber, int const* word, int value)
+				: fiber(fiber), word(word), value(value) {}
+			Fiber& fiber;
+			int const* word;
+			int value;
+		};
+	}
+
 	class Waiter : public Runnable {
 	public:
-		Waiter(Worker& worker)
-			: m_worker(worker)
-		{}
-		virtual ~Waiter() {}
+		Waiter(Worker& worker);
+		virtual ~Waiter();
 
 		void wait(TimedWaitable& w);
 		void scheduleTask(TimedWaitable& w);
@@ -187,8 +251,27 @@ namespace zth {
 #ifdef ZTH_HAVE_POLLER
 		void checkFdList();
 		int waitFd(AwaitFd& w);
+		int addFd(AwaitFd& w);
+		int removeFd(AwaitFd& w);
+#endif
+
+		void notify();
+		void waitNotify(int const* word = NULL, int value = 0);
+#ifdef ZTH_HAVE_SIGNALFD
+		int waitSignal(sigset_t const& set, siginfo_t* info = NULL);
 #endif
 
+		bool idle() const;
+		void checkTimers(Timestamp const& now = Timestamp::now());
+		void checkNotify();
+		void handleNotify();
+		void pollEvents(bool block);
+		void tick(Timestamp const& now = Timestamp::now());
+
+		int pollFd();
+		void updatePollFd();
+		Timestamp nextDeadline() const;
+
 	protected:
 		virtual int fiberHook(Fiber& f) {
 			f.setName("zth::Waiter");
@@ -197,13 +280,33 @@ namespace zth {
 		}
 
 		virtual void entry();
+#ifdef ZTH_HAVE_SIGNALFD
+		int updateSignalFd();
+#endif
 
 	private:
 		Worker& m_worker;
 		SortedList<TimedWaitable> m_waiting;
+		// [0] is polled and read, [1] is written by notify(). Both are the same for an eventfd.
+		int m_notifyFd[2];
+		int m_notified;
+		List<impl::NotifyWait> m_notifyList;
 #ifdef ZTH_HAVE_POLLER
 		List<AwaitFd> m_fdList;
 		std::vector<zth_pollfd_t> m_fdPollList;
+		Timestamp m_nextPoll;
+#endif
+#ifdef ZTH_HAVE_SIGNALFD
+		int m_signalFd;
+		// Per signal, the number of fibers that wait for it.
+		int m_signalWaiters[NSIG];
+#endif
+#ifdef ZTH_HAVE_EPOLL
+		// The epoll fd of pollFd(), with the events per fd that are registered to it.
+		int m_pollFd;
+		std::map<int,short> m_pollFdEvents;
+		// False when some awaited fds could not be registered to m_pollFd.
+		bool m_pollFdComplete;
 #endif
 	};
 
@@ -236,6 +339,11 @@ namespace zth {
 	 */
 	ZTH_EXPORT inline void unap(long sleepFor_us)				{ nap(TimeInterval((time_t)(sleepFor_us / 1000000L), sleepFor_us % 1000000L * 1000L)); }
 
+#ifdef ZTH_HAVE_SIGNALFD
+	ZTH_EXPORT int waitSignal(sigset_t const& set, siginfo_t* info = NULL);
+	ZTH_EXPORT int waitSignal(int sig, siginfo_t* info = NULL);
+#endif
+
 } // namespace 
 
 /*!
@@ -259,11 +367,23 @@ EXTERN_C ZTH_EXPORT ZTH_INLINE void zth_mnap(long sleepFor_ms) { zth::mnap(sleep
  */
 EXTERN_C ZTH_EXPORT ZTH_INLINE void zth_unap(long sleepFor_us) { zth::unap(sleepFor_us); }
 
+#  ifdef ZTH_HAVE_SIGNALFD
+/*!
+ * \copydoc zth::waitSignal(sigset_t const&, siginfo_t*)
+ * \details This is a C-wrapper for zth::waitSignal(sigset_t const&, siginfo_t*).
+ * \ingroup zth_api_c_fiber
+ */
+EXTERN_C ZTH_EXPORT ZTH_INLINE int zth_waitsignal(sigset_t const* set, siginfo_t* info) { return zth::waitSignal(*set, info); }
+#  endif
+
 #else // !__cplusplus
 
 ZTH_EXPORT void zth_nap(struct timespec const* ts);
 ZTH_EXPORT void zth_mnap(long sleepFor_ms);
 ZTH_EXPORT void zth_unap(long sleepFor_us);
+#  ifdef ZTH_HAVE_SIGNALFD
+ZTH_EXPORT int zth_waitsignal(sigset_t const* set, siginfo_t* info);
+#  endif
 
 #endif // __cplusplus
 #endif // __ZTH_WAITER_H
@@ -35,11 +35,49 @@
 namespace zth {
 	
 	void sigchld_check();
+	void sigchld_reap(pid_t pid);
 
 	class Worker;
 
 	ZTH_TLS_DECLARE(Worker*, currentWorker_)
 
+	namespace impl {
+		class AddressAlarm;
+
+		/*!
+		 * \brief A fiber in zth::waitOnAddress(), which lives on the stack of that fiber.
+		 */
+		struct AddressWait : public Listable<AddressWait> {
+			AddressWait(void const volatile* addr, Fiber& fiber)
+				: addr(addr), fiber(fiber), alarm(), timedOut() {}
+			void const volatile* addr;
+			Fiber& fiber;
+			AddressAlarm* alarm;
+			bool timedOut;
+		};
+
+		/*!
+		 * \brief The fibers of one Worker in zth::waitOnAddress(), hashed by the address they wait for.
+		 */
+		class AddressTable {
+		public:
+			AddressTable() {}
+
+			List<AddressWait>& bucket(void const volatile* addr) {
+				// Drop the alignment bits, as most addresses are of (at least) int-sized words.
+				uintptr_t a = (uintptr_t)addr >> 2;
+				return m_buckets[(a ^ (a >> 6) ^ (a >> 12)) % Buckets];
+			}
+
+		private:
+			AddressTable(AddressTable const&);
+			AddressTable& operator=(AddressTable const&);
+
+			enum { Buckets = 64 };
+			List<AddressWait> m_buckets[Buckets];
+		};
+	}
+
 	/*!
 	 * \ingroup zth_api_cpp_fiber
 	 */
@@ -54,6 +92,7 @@ namespace zth {
 			, m_workerFiber(&dummyWorkerEntry)
 			, m_waiter(*this)
 			, m_disableContextSwitch()
+			, m_runOnce()
 		{
 			zth_init();
 
@@ -78,7 +117,7 @@ namespace zth {
 
 			perf_event(PerfEvent<>(m_workerFiber));
 
-			if((res = waiter().run()))
+			if(Config::EnableWaiterFiber && (res = waiter().run()))
 				goto error;
 
 			return;
@@ -105,6 +144,13 @@ namespace zth {
 		}
 
 		Waiter& waiter() { return m_waiter; }
+		impl::AddressTable& addressTable() { return m_addressTable; }
+
+		/*!
+		 * \brief Wake up this Worker, when it is sleeping, and all fibers in Waiter::waitNotify().
+		 * \details This function can be called from any thread, and from a signal handler.
+		 */
+		void notify() { m_waiter.notify(); }
 
 		void add(Fiber* fiber) {
 			zth_assert(fiber);
@@ -154,6 +200,22 @@ namespace zth {
 			dbgStats();
 		}
 
+		/*!
+		 * \brief Switches to the runnable \p to, and lets the current fiber be the next one to run after it.
+		 * \details This is used to hand over control to a fiber that was just woken up,
+		 *          without making the current fiber wait a full round of other fibers.
+		 */
+		bool handoff(Fiber& to) {
+			Fiber* f = m_currentFiber;
+			if(likely(f && f != &to && f->state() == Fiber::Running)) {
+				// schedule() rotates the queue to the fiber after to, which is f then.
+				m_runnableQueue.erase(to);
+				m_runnableQueue.rotate(*f);
+				m_runnableQueue.push_front(to);
+			}
+			return schedule(&to);
+		}
+
 		bool schedule(Fiber* preferFiber = NULL, Timestamp const& now = Timestamp::now()) {
 			if(unlikely(!contextSwitchEnabled()))
 				// Don't switch, immediately continue.
@@ -175,6 +237,9 @@ namespace zth {
 				// Stop worker and return to its run1() call.
 				zth_dbg(worker, "[%s] Time is up", id_str());
 				preferFiber = &m_workerFiber;
+			} else if(!Config::EnableWaiterFiber) {
+				// Handle expired timers and ready fds inline, which may add fibers to the runnable queue.
+				m_waiter.tick(now);
 			}
 		
 			Fiber* fiber = preferFiber;
@@ -299,7 +364,22 @@ namespace zth {
 				m_end = Timestamp::now() + duration;
 			}
 
-			while(!m_runnableQueue.empty() && (runEnd().isNull() || Timestamp::now() < runEnd())) {
+			resumeWaiter();
+
+			while((!m_runnableQueue.empty() || (!Config::EnableWaiterFiber && !m_waiter.idle()))
+				&& (runEnd().isNull() || Timestamp::now() < runEnd()))
+			{
+				if(!Config::EnableWaiterFiber && m_runnableQueue.empty()) {
+					// Only sleeping fibers left; block till one of them can continue.
+					m_waiter.checkTimers();
+					if(m_runnableQueue.empty()) {
+						m_waiter.pollEvents(true);
+						m_waiter.checkTimers();
+					}
+					sigchld_check();
+					continue;
+				}
+
 				schedule();
 				zth_assert(!currentFiber());
 			}
@@ -307,7 +387,71 @@ namespace zth {
 			sigchld_check();
 		}
 
+		/*!
+		 * \brief Run the fibers that can run now, without blocking the thread.
+		 * \details Expired timers and ready fds are handled, and the runnable fibers are executed,
+		 *          until there are none left, or until \p maxDuration has passed.
+		 *
+		 *          Use this to embed the Worker in another event loop. Let that loop wait for #pollFd()
+		 *          to get readable, or until #nextDeadline(), and then call runOnce() again.
+		 */
+		void runOnce(TimeInterval const& maxDuration = TimeInterval(Config::MinTimeslice_s())) {
+			zth_dbg(worker, "[%s] Run once", id_str());
+			m_end = Timestamp::now() + maxDuration;
+			m_runOnce = true;
+
+			// Drain the notify fd unconditionally, as pending data keeps the pollFd() readable,
+			// while the Waiter only does it when it has something to do.
+			m_waiter.handleNotify();
+
+			if(Config::EnableWaiterFiber) {
+				resumeWaiter();
+			} else {
+				m_waiter.checkTimers();
+				m_waiter.pollEvents(false);
+			}
+
+			while(!m_runnableQueue.empty() && Timestamp::now() < runEnd()) {
+				schedule();
+				zth_assert(!currentFiber());
+			}
+
+			m_runOnce = false;
+			// Don't let a later run() inherit the deadline.
+			m_end = Timestamp::null();
+			m_waiter.updatePollFd();
+			sigchld_check();
+		}
+
+		bool runningOnce() const {
+			return m_runOnce;
+		}
+
+		/*!
+		 * \brief Returns an fd that gets readable when #runOnce() should be called.
+		 * \see zth::Waiter::pollFd()
+		 */
+		int pollFd() {
+			return m_waiter.pollFd();
+		}
+
+		/*!
+		 * \brief Returns when #runOnce() should be called at the latest, or a null Timestamp when only #pollFd() matters.
+		 */
+		Timestamp nextDeadline() const {
+			if(!m_runnableQueue.empty())
+				return Timestamp::now();
+
+			return m_waiter.nextDeadline();
+		}
+
 	protected:
+		void resumeWaiter() {
+			// The Waiter fiber suspends itself when it has nothing to do, or at the end of runOnce().
+			if(Config::EnableWaiterFiber && !m_waiter.idle() && m_waiter.fiber())
+				resume(*m_waiter.fiber());
+		}
+
 		static void dummyWorkerEntry(void*) {
 			zth_abort("The worker fiber should not be executed.");
 		}
@@ -341,8 +485,10 @@ namespace zth {
 		List<Fiber> m_suspendedQueue;
 		Fiber m_workerFiber;
 		Waiter m_waiter;
+		impl::AddressTable m_addressTable;
 		Timestamp m_end;
 		int m_disableContextSwitch;
+		bool m_runOnce;
 
 		friend void worker_global_init();
 	};
@@ -457,6 +603,56 @@ EXTERN_C ZTH_EXPORT ZTH_INLINE void zth_worker_run(struct timespec const* ts = N
 	w->run(ts ? zth::TimeInterval(ts->tv_sec, ts->tv_nsec) : zth::TimeInterval());
 }
 
+/*!
+ * \copydoc zth::Worker::runOnce()
+ * \details This is a C-wrapper for zth::Worker::runOnce().
+ * \ingroup zth_api_c_fiber
+ */
+EXTERN_C ZTH_EXPORT ZTH_INLINE void zth_worker_run_once() {
+	zth::Worker* w = zth::Worker::currentWorker();
+	if(unlikely(!w))
+		return;
+	w->runOnce();
+}
+
+/*!
+ * \copydoc zth::Worker::pollFd()
+ * \details This is a C-wrapper for zth::Worker::pollFd().
+ * \ingroup zth_api_c_fiber
+ */
+EXTERN_C ZTH_EXPORT ZTH_INLINE int zth_worker_pollfd() {
+	zth::Worker* w = zth::Worker::currentWorker();
+	if(unlikely(!w))
+		return -1;
+	return w->pollFd();
+}
+
+/*!
+ * \brief Returns the time in ms till the next deadline of the current Worker, which can be passed to \c poll().
+ * \return the timeout, which is 0 when zth_worker_run_once() should be called right away, or -1 when there is no deadline
+ * \ingroup zth_api_c_fiber
+ */
+EXTERN_C ZTH_EXPORT ZTH_INLINE int zth_worker_timeout() {
+	zth::Worker* w = zth::Worker::currentWorker();
+	if(unlikely(!w))
+		return -1;
+
+	zth::Timestamp deadline = w->nextDeadline();
+	if(deadline.isNull())
+		return -1;
+
+	zth::TimeInterval dt = deadline - zth::Timestamp::now();
+	if(dt <= 0)
+		return 0;
+
+	double ms = dt.s() * 1e3;
+	if(ms >= (double)std::numeric_limits<int>::max())
+		return std::numeric_limits<int>::max();
+
+	// Round up, to prevent waking up just too early.
+	return (int)ms + 1;
+}
+
 /*!
  * \ingroup zth_api_c_fiber
  */
@@ -491,6 +687,9 @@ ZTH_EXPORT void zth_outOfWork();
 
 ZTH_EXPORT int zth_worker_create();
 ZTH_EXPORT void zth_worker_run(struct timespec const* ts);
+ZTH_EXPORT void zth_worker_run_once();
+ZTH_EXPORT int zth_worker_pollfd();
+ZTH_EXPORT int zth_worker_timeout();
 ZTH_EXPORT int zth_worker_destroy();
 
 ZTH_EXPORT int zth_startWorkerThread(void(*f)(), size_t stack, char const* name);
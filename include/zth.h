@@ -37,9 +37,15 @@
 #include <libzth/fiber.h>
 #include <libzth/worker.h>
 #include <libzth/sync.h>
+#include <libzth/ring.h>
 #include <libzth/async.h>
 #include <libzth/perf.h>
 #include <libzth/io.h>
+#include <libzth/buffered.h>
+#include <libzth/blocking.h>
+#include <libzth/process.h>
+#include <libzth/mapped.h>
+#include <libzth/shm.h>
 #include <libzth/fsm.h>
 
 // You probably don't need these headers in your application.
@@ -0,0 +1,143 @@
+/*
+ * Zth (libzth), a cooperative userspace multitasking library.
+ * Copyright (C) 2019  Jochem Rutgers
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <libzth/blocking.h>
+#include <libzth/worker.h>
+#include <libzth/perf.h>
+
+#ifdef ZTH_HAVE_PTHREAD
+#  include <pthread.h>
+#endif
+
+namespace zth {
+
+#ifdef ZTH_HAVE_PTHREAD
+/*!
+ * \brief A zth_blocking() call, which lives on the stack of the calling fiber.
+ */
+struct BlockingJob {
+	void*(*f)(void*);
+	void* arg;
+	void* res;
+	int error;
+	int done;
+	Worker* worker;
+	BlockingJob* next;
+};
+
+static pthread_mutex_t blocking_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t blocking_cond = PTHREAD_COND_INITIALIZER;
+static BlockingJob* blocking_head;
+static BlockingJob* blocking_tail;
+static size_t blocking_threads;
+static size_t blocking_idle;
+
+static void* blocking_helper(void*) {
+	pthread_mutex_lock(&blocking_lock);
+
+	while(true) {
+		while(!blocking_head) {
+			blocking_idle++;
+			pthread_cond_wait(&blocking_cond, &blocking_lock);
+			blocking_idle--;
+		}
+
+		BlockingJob* job = blocking_head;
+		if(!(blocking_head = job->next))
+			blocking_tail = NULL;
+
+		pthread_mutex_unlock(&blocking_lock);
+
+		errno = 0;
+		job->res = job->f(job->arg);
+		job->error = errno;
+
+		// The job is gone as soon as done is set, but the worker is not.
+		Worker* worker = job->worker;
+		__atomic_store_n(&job->done, 1, __ATOMIC_RELEASE);
+		worker->notify();
+
+		pthread_mutex_lock(&blocking_lock);
+	}
+
+	return NULL;
+}
+
+/*!
+ * \brief Queue the given job, and make sure that there is a helper thread to execute it.
+ * \return 0 on success, otherwise an errno
+ */
+static int blocking_submit(BlockingJob& job) {
+	int res = 0;
+	pthread_mutex_lock(&blocking_lock);
+
+	if(!blocking_idle && blocking_threads < Config::BlockingThreads) {
+		pthread_t t;
+		if((res = pthread_create(&t, NULL, &blocking_helper, NULL))) {
+			if(!blocking_threads)
+				// Nobody is going to pick it up.
+				goto done;
+			res = 0;
+		} else {
+			pthread_detach(t);
+			blocking_threads++;
+			zth_dbg(worker, "Started helper thread %u for blocking calls", (unsigned)blocking_threads);
+		}
+	}
+
+	job.next = NULL;
+	if(blocking_tail)
+		blocking_tail->next = &job;
+	else
+		blocking_head = &job;
+	blocking_tail = &job;
+
+	pthread_cond_signal(&blocking_cond);
+done:
+	pthread_mutex_unlock(&blocking_lock);
+	return res;
+}
+#endif // ZTH_HAVE_PTHREAD
+
+} // namespace
+
+void* zth_blocking(void*(*f)(void*), void* arg) {
+	zth::perf_syscall("blocking()");
+
+#ifdef ZTH_HAVE_PTHREAD
+	zth::Worker* worker = zth::Worker::currentWorker();
+	if(likely(worker && worker->currentFiber())) {
+		zth::BlockingJob job = {};
+		job.f = f;
+		job.arg = arg;
+		job.worker = worker;
+
+		if(likely(!zth::blocking_submit(job))) {
+			while(!__atomic_load_n(&job.done, __ATOMIC_ACQUIRE))
+				worker->waiter().waitNotify(&job.done, 0);
+
+			errno = job.error;
+			return job.res;
+		}
+	}
+#endif
+
+	// Just do the call.
+	return f(arg);
+}
@@ -0,0 +1,563 @@
+/*
+ * Zth (libzth), a cooperative userspace multitasking library.
+ * Copyright (C) 2019  Jochem Rutgers
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define ZTH_REDIRECT_IO 0
+#include <libzth/buffered.h>
+#include <libzth/worker.h>
+
+#if defined(ZTH_HAVE_POLLER) && !defined(ZTH_OS_WINDOWS)
+
+#include <algorithm>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace zth { namespace io {
+
+/*!
+ * \brief Wait till \p fd has the given \p events, while other fibers continue.
+ * \return 0 on success, otherwise an \c errno
+ */
+static int awaitFd(int fd, short events) {
+	zth_pollfd_t p = zth_pollfd_t();
+	p.fd = fd;
+	p.events = events;
+
+#  ifdef ZTH_HAVE_LIBZMQ
+	switch(::zmq_poll(&p, 1, 0)) {
+	case -1: return zmq_errno();
+#  else
+	switch(::poll(&p, 1, 0)) {
+	case -1: return errno;
+#  endif
+	case 0: break;
+	default: return 0;
+	}
+
+	zth_dbg(io, "[%s] poll(%d) hand-off", currentFiber().str().c_str(), fd);
+	AwaitFd w(&p, 1);
+	return currentWorker().waiter().waitFd(w);
+}
+
+/*!
+ * \brief Like \c %readv(), but waits for data via the zth::Waiter.
+ */
+static ssize_t readv_(int fd, struct iovec* iov, int iovcnt) {
+	while(true) {
+		if(int error = awaitFd(fd, POLLIN)) {
+			errno = error;
+			return -1;
+		}
+
+		ssize_t res = ::readv(fd, iov, iovcnt);
+		if(res != -1 || errno != EAGAIN)
+			return res;
+	}
+}
+
+////////////////////////////////////////////////////////////////
+// RingBuffer
+//
+
+RingBuffer::RingBuffer(size_t size)
+	: m_buffer((char*)malloc(size))
+	, m_size(m_buffer ? size : 0)
+	, m_head()
+	, m_used()
+{}
+
+RingBuffer::~RingBuffer() {
+	free(m_buffer);
+}
+
+/*!
+ * \brief Fills \p iov (which must have room for two elements) with the data in the buffer, in order.
+ * \return the number of filled elements
+ */
+int RingBuffer::dataSegments(struct iovec* iov) const {
+	if(!m_used)
+		return 0;
+
+	size_t first = std::min(m_used, m_size - m_head);
+	iov[0].iov_base = m_buffer + m_head;
+	iov[0].iov_len = first;
+	if(first == m_used)
+		return 1;
+
+	iov[1].iov_base = m_buffer;
+	iov[1].iov_len = m_used - first;
+	return 2;
+}
+
+/*!
+ * \brief Fills \p iov (which must have room for two elements) with the free space in the buffer, in order.
+ * \details Call #produced() afterwards to add the data that was written to this space.
+ * \return the number of filled elements
+ */
+int RingBuffer::spaceSegments(struct iovec* iov) {
+	if(!m_used)
+		// Maximize the contiguous space.
+		m_head = 0;
+
+	size_t space = m_size - m_used;
+	if(!space)
+		return 0;
+
+	size_t tail = (m_head + m_used) % m_size;
+	size_t first = std::min(space, m_size - tail);
+	iov[0].iov_base = m_buffer + tail;
+	iov[0].iov_len = first;
+	if(first == space)
+		return 1;
+
+	iov[1].iov_base = m_buffer;
+	iov[1].iov_len = space - first;
+	return 2;
+}
+
+void RingBuffer::produced(size_t count) {
+	zth_assert(count <= space());
+	m_used += count;
+}
+
+void RingBuffer::consumed(size_t count) {
+	zth_assert(count <= m_used);
+	m_used -= count;
+	m_head = m_used ? (m_head + count) % m_size : 0;
+}
+
+/*!
+ * \brief Copies at most \p count bytes from the buffer, without consuming them.
+ * \return the number of copied bytes
+ */
+size_t RingBuffer::peek(void* buf, size_t count) const {
+	struct iovec iov[2];
+	int n = dataSegments(iov);
+	size_t done = 0;
+	for(int i = 0; i < n && done < count; i++) {
+		size_t len = std::min(count - done, iov[i].iov_len);
+		memcpy((char*)buf + done, iov[i].iov_base, len);
+		done += len;
+	}
+	return done;
+}
+
+/*!
+ * \brief Copies and consumes at most \p count bytes from the buffer.
+ * \return the number of copied bytes
+ */
+size_t RingBuffer::get(void* buf, size_t count) {
+	size_t res = peek(buf, count);
+	consumed(res);
+	return res;
+}
+
+/*!
+ * \brief Copies at most \p count bytes into the buffer.
+ * \return the number of copied bytes
+ */
+size_t RingBuffer::put(void const* buf, size_t count) {
+	struct iovec iov[2];
+	int n = spaceSegments(iov);
+	size_t done = 0;
+	for(int i = 0; i < n && done < count; i++) {
+		size_t len = std::min(count - done, iov[i].iov_len);
+		memcpy(iov[i].iov_base, (char const*)buf + done, len);
+		done += len;
+	}
+	produced(done);
+	return done;
+}
+
+/*!
+ * \brief Searches for \p c in the buffered data, starting at \p offset.
+ * \return the offset of \p c, or \c (size_t)-1 when not found
+ */
+size_t RingBuffer::find(char c, size_t offset) const {
+	struct iovec iov[2];
+	int n = dataSegments(iov);
+	size_t base = 0;
+	for(int i = 0; i < n; base += iov[i].iov_len, i++) {
+		if(offset >= base + iov[i].iov_len)
+			continue;
+
+		size_t start = offset > base ? offset - base : 0;
+		char const* p = (char const*)memchr((char const*)iov[i].iov_base + start, c, iov[i].iov_len - start);
+		if(p)
+			return base + (size_t)(p - (char const*)iov[i].iov_base);
+	}
+	return (size_t)-1;
+}
+
+/*!
+ * \brief Moves \p count bytes from \p buffer to the end of \p s.
+ */
+static void append(std::string& s, RingBuffer& buffer, size_t count) {
+	struct iovec iov[2];
+	int n = buffer.dataSegments(iov);
+	size_t done = 0;
+	for(int i = 0; i < n && done < count; i++) {
+		size_t len = std::min(count - done, iov[i].iov_len);
+		s.append((char const*)iov[i].iov_base, len);
+		done += len;
+	}
+	buffer.consumed(done);
+}
+
+
+////////////////////////////////////////////////////////////////
+// BufferedReader
+//
+
+BufferedReader::BufferedReader(int fd, size_t size)
+	: m_fd(fd)
+	, m_buffer(size)
+{}
+
+/*!
+ * \brief Reads as much as fits in the buffer, using a single \c readv().
+ * \details Waits via the zth::Waiter when no data is available.
+ * \return the number of bytes read, 0 on end-of-file, or -1 on error with \c errno set
+ */
+ssize_t BufferedReader::fill() {
+	perf_syscall("BufferedReader::fill()");
+
+	struct iovec iov[2];
+	int n = m_buffer.spaceSegments(iov);
+	if(!n) {
+		errno = m_buffer.size() ? ENOBUFS : ENOMEM;
+		return -1;
+	}
+
+	ssize_t res = readv_(m_fd, iov, n);
+	if(res > 0)
+		m_buffer.produced((size_t)res);
+	return res;
+}
+
+/*!
+ * \brief Like \c %read(), but via the buffer.
+ * \details When the buffer is empty, and \p count is not less than its size, \p buf is filled directly.
+ * \return the number of bytes read, 0 on end-of-file, or -1 on error with \c errno set
+ */
+ssize_t BufferedReader::read_(void* buf, size_t count) {
+	if(!count)
+		return 0;
+
+	if(m_buffer.empty()) {
+		if(count >= m_buffer.size()) {
+			struct iovec iov = { buf, count };
+			return readv_(m_fd, &iov, 1);
+		}
+
+		ssize_t res = fill();
+		if(res <= 0)
+			return res;
+	}
+
+	return (ssize_t)m_buffer.get(buf, count);
+}
+
+/*!
+ * \brief Reads exactly \p count bytes, unless end-of-file is reached first.
+ * \return \p count, less on end-of-file, or -1 on error with \c errno set (and the data read so far is lost)
+ */
+ssize_t BufferedReader::readExact(void* buf, size_t count) {
+	size_t done = 0;
+	while(done < count) {
+		ssize_t res = read_((char*)buf + done, count - done);
+		if(res < 0)
+			return -1;
+		if(res == 0)
+			break;
+		done += (size_t)res;
+	}
+	return (ssize_t)done;
+}
+
+/*!
+ * \brief Reads up to and including \p delim.
+ * \param line receives the line, without \p delim
+ * \param delim the line delimiter
+ * \param maxLength when non-zero, the maximum length of \p line; longer lines result in \c EMSGSIZE
+ * \return the number of consumed bytes (including \p delim), 0 on end-of-file, or -1 on error with \c errno set
+ */
+ssize_t BufferedReader::readLine(std::string& line, char delim, size_t maxLength) {
+	line.clear();
+	size_t consumed = 0;
+	size_t scanned = 0;
+
+	while(true) {
+		size_t pos = m_buffer.find(delim, scanned);
+		size_t len = pos == (size_t)-1 ? m_buffer.used() : pos;
+
+		if(maxLength && line.size() + len > maxLength) {
+			errno = EMSGSIZE;
+			return -1;
+		}
+
+		if(pos != (size_t)-1) {
+			append(line, m_buffer, len);
+			m_buffer.consumed(1);
+			return (ssize_t)(consumed + len + 1);
+		}
+
+		if(m_buffer.full()) {
+			// The line does not fit in the buffer; move what we have to make room.
+			consumed += len;
+			append(line, m_buffer, len);
+			scanned = 0;
+		} else {
+			scanned = len;
+		}
+
+		ssize_t res = fill();
+		if(res < 0)
+			return -1;
+		if(res == 0) {
+			// End-of-file; return the last line, which has no delimiter.
+			consumed += m_buffer.used();
+			append(line, m_buffer, m_buffer.used());
+			return (ssize_t)consumed;
+		}
+	}
+}
+
+/*!
+ * \brief Reads a frame, which is prefixed by its length as a 32-bit big-endian integer.
+ * \param frame receives the frame, without the length prefix
+ * \param maxLength when non-zero, the maximum length of \p frame; longer frames result in \c EMSGSIZE.
+ *                  Without it, the length is only limited by the data that actually arrives.
+ * \return the number of consumed bytes (including the prefix), 0 on end-of-file,
+ *         or -1 on error with \c errno set (\c EPROTO when the stream ends within a frame)
+ * \see zth::io::BufferedWriter::writeFrame()
+ */
+ssize_t BufferedReader::readFrame(std::string& frame, size_t maxLength) {
+	frame.clear();
+
+	while(m_buffer.used() < 4) {
+		ssize_t res = fill();
+		if(res < 0)
+			return -1;
+		if(res == 0) {
+			if(m_buffer.empty())
+				return 0;
+			errno = EPROTO;
+			return -1;
+		}
+	}
+
+	unsigned char prefix[4];
+	m_buffer.peek(prefix, sizeof(prefix));
+	size_t len = ((size_t)prefix[0] << 24) | ((size_t)prefix[1] << 16) | ((size_t)prefix[2] << 8) | (size_t)prefix[3];
+
+	if(maxLength && len > maxLength) {
+		errno = EMSGSIZE;
+		return -1;
+	}
+
+	m_buffer.consumed(sizeof(prefix));
+	// Don't trust the prefix for the allocation; beyond this, the frame grows as data arrives.
+	frame.reserve(std::min(len, (size_t)0x10000));
+
+	while(true) {
+		append(frame, m_buffer, std::min(len - frame.size(), m_buffer.used()));
+		if(frame.size() == len)
+			return (ssize_t)(sizeof(prefix) + len);
+
+		ssize_t res = fill();
+		if(res < 0)
+			return -1;
+		if(res == 0) {
+			errno = EPROTO;
+			return -1;
+		}
+	}
+}
+
+
+////////////////////////////////////////////////////////////////
+// BufferedWriter
+//
+
+BufferedWriter::BufferedWriter(int fd, size_t size, TimeInterval const& flushDelay)
+	: m_fd(fd)
+	, m_buffer(size)
+	, m_flushDelay(flushDelay)
+	, m_flushTask(*this)
+	, m_scheduled()
+	, m_flushing()
+{}
+
+/*!
+ * \details Flushes the buffer.
+ */
+BufferedWriter::~BufferedWriter() {
+	if(m_scheduled)
+		unscheduleTask(m_flushTask);
+
+	flush();
+}
+
+/*!
+ * \brief Like \c %write(), but via the buffer.
+ * \details When \p buf does not fit in the buffer, both are written with a single \c writev().
+ * \return \p count, or -1 on error with \c errno set
+ */
+ssize_t BufferedWriter::write(void const* buf, size_t count) {
+	if(count <= m_buffer.space()) {
+		m_buffer.put(buf, count);
+
+		if(!m_scheduled && !m_buffer.empty()) {
+			m_flushTask.setTimeout(Timestamp::now() + m_flushDelay);
+			scheduleTask(m_flushTask);
+			m_scheduled = true;
+		}
+
+		return (ssize_t)count;
+	}
+
+	return writev(buf, count, true);
+}
+
+/*!
+ * \brief Writes a frame, prefixed by its length as a 32-bit big-endian integer.
+ * \return the number of written bytes (including the prefix), or -1 on error with \c errno set
+ * \see zth::io::BufferedReader::readFrame()
+ */
+ssize_t BufferedWriter::writeFrame(void const* buf, size_t count) {
+	if((uint64_t)count > 0xffffffffULL) {
+		errno = EMSGSIZE;
+		return -1;
+	}
+
+	unsigned char prefix[4] = {
+		(unsigned char)(count >> 24), (unsigned char)(count >> 16),
+		(unsigned char)(count >> 8), (unsigned char)count };
+
+	if(m_buffer.space() < sizeof(prefix) && flush())
+		return -1;
+
+	if(write(prefix, sizeof(prefix)) == -1 || write(buf, count) == -1)
+		return -1;
+
+	return (ssize_t)(sizeof(prefix) + count);
+}
+
+/*!
+ * \brief Writes all buffered data.
+ * \details Waits via the zth::Waiter when the fd cannot accept all data at once.
+ * \return 0 on success, or -1 on error with \c errno set
+ */
+int BufferedWriter::flush() {
+	if(m_buffer.empty())
+		return 0;
+
+	return writev(NULL, 0, true) == -1 ? -1 : 0;
+}
+
+/*!
+ * \brief Writes the buffered data, followed by \p extra.
+ * \details The fd is made non-blocking during this call, like zth::io::sendfile() does.
+ * \param block when \c true, wait via the zth::Waiter till everything is written; otherwise, give up with \c EAGAIN
+ * \return the number of bytes written of \p extra, or -1 on error with \c errno set
+ */
+ssize_t BufferedWriter::writev(void const* extra, size_t extraCount, bool block) {
+	if(block)
+		perf_syscall("BufferedWriter::writev()");
+
+	NonBlocking nb(m_fd);
+	m_flushing = true;
+
+	size_t extraDone = 0;
+	int error = 0;
+
+	while(!m_buffer.empty() || extraDone < extraCount) {
+		struct iovec iov[3];
+		int n = m_buffer.dataSegments(iov);
+		if(extraDone < extraCount) {
+			iov[n].iov_base = (void*)((char const*)extra + extraDone);
+			iov[n].iov_len = extraCount - extraDone;
+			n++;
+		}
+
+		ssize_t res = ::writev(m_fd, iov, n);
+		if(res == -1) {
+			if(errno == EINTR)
+				continue;
+			if(errno != EAGAIN || !block) {
+				error = errno;
+				break;
+			}
+
+			zth_dbg(io, "[%s] writev(%d) hand-off", currentFiber().str().c_str(), m_fd);
+			if((error = awaitFd(m_fd, POLLOUT)))
+				break;
+			continue;
+		}
+
+		size_t fromBuffer = std::min((size_t)res, m_buffer.used());
+		m_buffer.consumed(fromBuffer);
+		extraDone += (size_t)res - fromBuffer;
+	}
+
+	m_flushing = false;
+
+	if(error) {
+		errno = error;
+		return -1;
+	}
+
+	return (ssize_t)extraDone;
+}
+
+/*!
+ * \brief Flushes the buffer, as far as possible without blocking.
+ * \details Called by the zth::Waiter, when the flush delay has passed.
+ * \return \c true when done, \c false when it should be called again later
+ */
+bool BufferedWriter::flushTask(Timestamp const& now) {
+	if(!m_flushing && !m_buffer.empty()) {
+		int errno_ = errno;
+		ssize_t res = writev(NULL, 0, false);
+		bool retry = res == -1 && errno == EAGAIN;
+		errno = errno_;
+
+		if(!retry) {
+			// Done, or some error, which is reported by the next write() or flush().
+			m_scheduled = false;
+			return true;
+		}
+	} else if(m_buffer.empty()) {
+		m_scheduled = false;
+		return true;
+	}
+
+	// Busy, or the fd is full; try again later.
+	m_flushTask.setTimeout(now + std::max(m_flushDelay, TimeInterval(Config::MinTimeslice_s())));
+	return false;
+}
+
+bool BufferedWriter::FlushTask::poll(Timestamp const& now) {
+	return m_writer.flushTask(now);
+}
+
+} } // namespace
+#else
+static int no_buffered __attribute__((unused));
+#endif // ZTH_HAVE_POLLER && !ZTH_OS_WINDOWS
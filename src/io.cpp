@@ -29,6 +29,12 @@
 #    include <alloca.h>
 #  endif
 #  include <fcntl.h>
+#  include <limits.h>
+#  include <string.h>
+#  include <sys/stat.h>
+#  ifdef ZTH_OS_LINUX
+#    include <sys/sendfile.h>
+#  endif
 #  ifndef POLLIN_SET
 #    define POLLIN_SET (/*POLLRDBAND |*/ POLLIN | /*POLLHUP |*/ POLLERR)
 #  endif
@@ -95,6 +101,139 @@ ssize_t read(int fd, void* buf, size_t count) {
 	}
 }
 
+/*!
+ * \brief Writes in parts, while waiting in the #zth::Waiter for room in between.
+ * \details For a socket, \c MSG_DONTWAIT is used. Otherwise, the fd must be non-blocking already.
+ */
+static ssize_t writeParts(int fd, char const* p, size_t count, bool socket) {
+	size_t done = 0;
+
+	while(true) {
+		ssize_t res = socket
+			? ::send(fd, p + done, count - done, MSG_DONTWAIT)
+			: ::write(fd, p + done, count - done);
+		if(res == -1) {
+			if(errno != EAGAIN && errno != EWOULDBLOCK)
+				// Error. Return with errno set, unless something was written already.
+				return done ? (ssize_t)done : -1;
+		} else if((done += (size_t)res) == count || res == 0) {
+			return (ssize_t)done;
+		} else {
+			// Partially written, try the rest.
+			continue;
+		}
+
+		if(socket) {
+			// A non-blocking socket should not wait.
+			int flags = fcntl(fd, F_GETFL);
+			if(flags == -1 || (flags & O_NONBLOCK)) {
+				if(done)
+					return (ssize_t)done;
+				if(flags != -1)
+					errno = EAGAIN;
+				return -1;
+			}
+		}
+
+		// No room, so forward our request to the Waiter.
+		zth_dbg(io, "[%s] write(%d) hand-off", currentFiber().str().c_str(), fd);
+		Await1Fd w(fd, POLLOUT_SET);
+		if(currentWorker().waiter().waitFd(w)) {
+			if(done)
+				return (ssize_t)done;
+			errno = w.error();
+			return -1;
+		}
+	}
+}
+
+/*!
+ * \brief Like normal \c %write(), but forwards the \c %poll() to the #zth::Waiter in case it would block.
+ * \details Only pipes and sockets are handed off. For other fds, like regular files and ttys,
+ *          \c %poll() does not tell whether the write would block.
+ *
+ *          As \c POLLOUT does not guarantee that all data fits, the data is written in parts,
+ *          while waiting for room in between. A socket is written with \c MSG_DONTWAIT.
+ *          A blocking pipe is made non-blocking during this call, but only when it has no room for
+ *          the data right away. Note that this flag is shared by all duplicates of the fd,
+ *          including the ones in other processes, which may get \c EAGAIN in the meantime.
+ * \ingroup zth_api_cpp_io
+ */
+ssize_t write(int fd, void const* buf, size_t count) {
+	perf_syscall("write()");
+
+	struct stat st;
+	if(fstat(fd, &st) == -1 || !(S_ISFIFO(st.st_mode) || S_ISSOCK(st.st_mode))) {
+		zth_dbg(io, "[%s] write(%d) direct", currentFiber().str().c_str(), fd);
+		// Just do the call.
+		return ::write(fd, buf, count);
+	}
+
+	char const* p = static_cast<char const*>(buf);
+
+	if(S_ISSOCK(st.st_mode))
+		return writeParts(fd, p, count, true);
+
+	int flags = fcntl(fd, F_GETFL);
+	if(unlikely(flags == -1))
+		return -1; // with errno set
+
+	if((flags & O_NONBLOCK)) {
+		zth_dbg(io, "[%s] write(%d) non-blocking", currentFiber().str().c_str(), fd);
+		// Just do the call.
+		return ::write(fd, buf, count);
+	}
+
+	if(count <= PIPE_BUF) {
+		zth_pollfd_t fds = {};
+		fds.fd = fd;
+		fds.events = POLLOUT_SET;
+#  ifdef ZTH_HAVE_LIBZMQ
+		if(::zmq_poll(&fds, 1, 0) == 1)
+#  else
+		if(::poll(&fds, 1, 0) == 1)
+#  endif
+			// A pipe with room takes PIPE_BUF bytes without blocking.
+			return ::write(fd, buf, count);
+	}
+
+	NonBlocking nb(fd);
+	return writeParts(fd, p, count, false);
+}
+
+/*!
+ * \brief Like normal \c %connect(), but forwards the \c %poll() to the #zth::Waiter in case it would block.
+ * \details A blocking socket is made non-blocking while the connection is in progress.
+ * \ingroup zth_api_cpp_io
+ */
+int connect(int sockfd, struct sockaddr const* addr, socklen_t addrlen) {
+	perf_syscall("connect()");
+
+	NonBlocking nb(sockfd);
+	if(::connect(sockfd, addr, addrlen) == 0)
+		return 0;
+	if(errno != EINPROGRESS || !nb.changed())
+		return -1;
+
+	zth_dbg(io, "[%s] connect(%d) hand-off", currentFiber().str().c_str(), sockfd);
+	Await1Fd w(sockfd, POLLOUT_SET);
+	if(currentWorker().waiter().waitFd(w)) {
+		errno = w.error();
+		return -1;
+	}
+
+	int error = 0;
+	socklen_t len = sizeof(error);
+	if(getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &error, &len))
+		return -1;
+	if(error) {
+		errno = error;
+		return -1;
+	}
+
+	return 0;
+}
+
 /*!
  * \brief Like normal \c %select(), but forwards the \c %poll() to the #zth::Waiter in case it would block.
  * \ingroup zth_api_cpp_io
@@ -118,8 +257,8 @@ int select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, struc
 	zth_pollfd_t* fds_heap = NULL;
 	zth_pollfd_t* fds = NULL;
 	if(nfds < 16)
-		fds = (zth_pollfd_t*)alloca(sizeof(zth_pollfd_t*) * nfds * 3);
-	else if(!(fds = fds_heap = (zth_pollfd_t*)malloc(sizeof(zth_pollfd_t*) * nfds * 3))) {
+		fds = (zth_pollfd_t*)alloca(sizeof(zth_pollfd_t) * nfds * 3);
+	else if(!(fds = fds_heap = (zth_pollfd_t*)malloc(sizeof(zth_pollfd_t) * nfds * 3))) {
 		errno = ENOMEM;
 		return -1;
 	}
@@ -128,18 +267,21 @@ int select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, struc
 	for(int fd = 0; fd < nfds; fd++) {
 		if(readfds)
 			if(FD_ISSET(fd, readfds)) {
+				fds[nfds_poll] = zth_pollfd_t();
 				fds[nfds_poll].fd = fd;
 				fds[nfds_poll].events = POLLIN_SET;
 				nfds_poll++;
 			}
 		if(writefds)
 			if(FD_ISSET(fd, writefds)) {
+				fds[nfds_poll] = zth_pollfd_t();
 				fds[nfds_poll].fd = fd;
 				fds[nfds_poll].events = POLLOUT_SET;
 				nfds_poll++;
 			}
 		if(exceptfds)
 			if(FD_ISSET(fd, exceptfds)) {
+				fds[nfds_poll] = zth_pollfd_t();
 				fds[nfds_poll].fd = fd;
 				fds[nfds_poll].events = POLLEX_SET;
 				nfds_poll++;
@@ -166,15 +308,15 @@ int select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, struc
 	
 	for(int i = 0; i < nfds_poll; i++) {
 		if(readfds && (fds[i].revents & POLLIN_SET)) {
-			FD_SET(i, readfds);
+			FD_SET(fds[i].fd, readfds);
 			res++;
 		}
 		if(writefds && (fds[i].revents & POLLOUT_SET)) {
-			FD_SET(i, writefds);
+			FD_SET(fds[i].fd, writefds);
 			res++;
 		}
 		if(exceptfds && (fds[i].revents & POLLEX_SET)) {
-			FD_SET(i, exceptfds);
+			FD_SET(fds[i].fd, exceptfds);
 			res++;
 		}
 	}
@@ -208,6 +350,19 @@ int poll(zth_pollfd_t *fds, int nfds, int timeout) {
 	Timestamp t;
 	if(timeout > 0)
 		t = Timestamp::now() + TimeInterval(timeout / 1000, (long)(timeout % 1000) * 1000000L);
+
+	if(nfds < 0) {
+		errno = EINVAL;
+		return -1;
+	} else if(nfds == 0) {
+		// Just a sleep, as the Waiter cannot wait for an empty set of fds.
+		if(timeout < 0)
+			// Like the real poll() without a signal handler, never return.
+			while(true)
+				suspend();
+		nap(t);
+		return 0;
+	}
 	
 	AwaitFd w(fds, nfds, t);
 	if(currentWorker().waiter().waitFd(w)) {
@@ -219,6 +374,501 @@ int poll(zth_pollfd_t *fds, int nfds, int timeout) {
 	return w.result();
 }
 
+#  ifdef ZTH_HAVE_EPOLL
+PollSet::PollSet()
+	: m_epfd(-1)
+{}
+
+PollSet::~PollSet() {
+	if(m_epfd != -1)
+		close(m_epfd);
+}
+
+/*!
+ * \brief Adds \p fd to the set.
+ * \param events the \c POLLIN / \c POLLOUT / \c POLLPRI events to wait for
+ * \param user passed back via the #Event of this fd
+ * \return 0 on success, or -1 on error with \c errno set
+ */
+int PollSet::add(int fd, short events, void* user) {
+	if(m_epfd == -1 && (m_epfd = epoll_create1(EPOLL_CLOEXEC)) == -1)
+		return -1;
+
+	if(m_entries.count(fd)) {
+		errno = EEXIST;
+		return -1;
+	}
+
+	Entry& e = m_entries[fd];
+	e.fd = fd;
+	e.user = user;
+
+	struct epoll_event ev = {};
+	ev.events = impl::toEpoll(events);
+	ev.data.ptr = &e;
+	if(epoll_ctl(m_epfd, EPOLL_CTL_ADD, fd, &ev)) {
+		int error = errno;
+		m_entries.erase(fd);
+		errno = error;
+		return -1;
+	}
+
+	return 0;
+}
+
+/*!
+ * \brief Changes the events and user pointer of an fd in the set.
+ * \return 0 on success, or -1 on error with \c errno set
+ */
+int PollSet::modify(int fd, short events, void* user) {
+	std::map<int,Entry>::iterator it = m_entries.find(fd);
+	if(it == m_entries.end()) {
+		errno = ENOENT;
+		return -1;
+	}
+
+	struct epoll_event ev = {};
+	ev.events = impl::toEpoll(events);
+	ev.data.ptr = &it->second;
+	if(epoll_ctl(m_epfd, EPOLL_CTL_MOD, fd, &ev))
+		return -1;
+
+	it->second.user = user;
+	return 0;
+}
+
+/*!
+ * \brief Removes \p fd from the set.
+ * \details Do this before closing the fd.
+ * \return 0 on success, or -1 on error with \c errno set
+ */
+int PollSet::remove(int fd) {
+	std::map<int,Entry>::iterator it = m_entries.find(fd);
+	if(it == m_entries.end()) {
+		errno = ENOENT;
+		return -1;
+	}
+
+	m_entries.erase(it);
+	return epoll_ctl(m_epfd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+size_t PollSet::size() const {
+	return m_entries.size();
+}
+
+/*!
+ * \brief Fills the ready list, without blocking.
+ * \return the number of ready fds, or -1 on error with \c errno set
+ */
+int PollSet::collect() {
+	m_ready.clear();
+	if(m_entries.empty())
+		return 0;
+
+	m_events.resize(m_entries.size());
+	int res = epoll_wait(m_epfd, &m_events[0], (int)m_events.size(), 0);
+	for(int i = 0; i < res; i++) {
+		Entry const& e = *static_cast<Entry const*>(m_events[(size_t)i].data.ptr);
+		Event ev = { e.fd, impl::fromEpoll(m_events[(size_t)i].events), e.user };
+		m_ready.push_back(ev);
+	}
+	return res;
+}
+#  else // !ZTH_HAVE_EPOLL
+PollSet::PollSet() {}
+
+PollSet::~PollSet() {}
+
+int PollSet::add(int fd, short events, void* user) {
+	for(size_t i = 0; i < m_fds.size(); i++)
+		if(m_fds[i].fd == fd) {
+			errno = EEXIST;
+			return -1;
+		}
+
+	zth_pollfd_t p = zth_pollfd_t();
+	p.fd = fd;
+	p.events = events;
+	m_fds.push_back(p);
+	m_user.push_back(user);
+	return 0;
+}
+
+int PollSet::modify(int fd, short events, void* user) {
+	for(size_t i = 0; i < m_fds.size(); i++)
+		if(m_fds[i].fd == fd) {
+			m_fds[i].events = events;
+			m_user[i] = user;
+			return 0;
+		}
+
+	errno = ENOENT;
+	return -1;
+}
+
+int PollSet::remove(int fd) {
+	for(size_t i = 0; i < m_fds.size(); i++)
+		if(m_fds[i].fd == fd) {
+			m_fds.erase(m_fds.begin() + (ptrdiff_t)i);
+			m_user.erase(m_user.begin() + (ptrdiff_t)i);
+			return 0;
+		}
+
+	errno = ENOENT;
+	return -1;
+}
+
+size_t PollSet::size() const {
+	return m_fds.size();
+}
+
+int PollSet::collect() {
+	m_ready.clear();
+	if(m_fds.empty())
+		return 0;
+
+#    ifdef ZTH_HAVE_LIBZMQ
+	int res = ::zmq_poll(&m_fds[0], (int)m_fds.size(), 0);
+#    else
+	int res = ::poll(&m_fds[0], (nfds_t)m_fds.size(), 0);
+#    endif
+	for(size_t i = 0; res > 0 && i < m_fds.size(); i++)
+		if(m_fds[i].revents) {
+			Event ev = { m_fds[i].fd, m_fds[i].revents, m_user[i] };
+			m_ready.push_back(ev);
+		}
+	return res;
+}
+#  endif // !ZTH_HAVE_EPOLL
+
+/*!
+ * \brief Waits till at least one fd in the set is ready, while other fibers continue.
+ * \param timeout the timeout in ms, 0 to only check, or -1 to wait indefinitely
+ * \return the number of ready fds, which are available via #ready(), 0 on timeout, or -1 on error with \c errno set
+ */
+int PollSet::wait(int timeout) {
+	perf_syscall("PollSet::wait()");
+
+	int res = collect();
+	if(res != 0 || timeout == 0)
+		return res;
+
+	Timestamp t;
+	if(timeout > 0)
+		t = Timestamp::now() + TimeInterval(timeout / 1000, (long)(timeout % 1000) * 1000000L);
+
+	if(!size()) {
+		if(t.isNull()) {
+			errno = EINVAL;
+			return -1;
+		}
+		nap(t);
+		return 0;
+	}
+
+	while(true) {
+		zth_dbg(io, "[%s] PollSet::wait(%d) hand-off", currentFiber().str().c_str(), (int)size());
+#  ifdef ZTH_HAVE_EPOLL
+		Await1Fd w(m_epfd, POLLIN, t);
+#  else
+		AwaitFd w(&m_fds[0], (int)m_fds.size(), t);
+#  endif
+		if(int error = currentWorker().waiter().waitFd(w)) {
+			errno = error;
+			return -1;
+		}
+
+		if((res = collect()) != 0)
+			return res;
+		if(!t.isNull() && t.isBefore(Timestamp::now()))
+			return 0;
+	}
+}
+
+#  ifdef ZTH_OS_LINUX
+/*!
+ * \brief Wait till \p fd_in is readable and \p fd_out is writable, while other fibers continue.
+ * \return 0 on success, otherwise an \c errno
+ */
+static int awaitInOut(int fd_in, int fd_out) {
+	zth_pollfd_t fds[2] = {};
+	fds[0].fd = fd_in;
+	fds[0].events = POLLIN_SET;
+	fds[1].fd = fd_out;
+	fds[1].events = POLLOUT_SET;
+
+#    ifdef ZTH_HAVE_LIBZMQ
+	if(::zmq_poll(fds, 2, 0) == -1)
+		return zmq_errno();
+#    else
+	if(::poll(fds, 2, 0) == -1)
+		return errno;
+#    endif
+
+	if(fds[0].revents && fds[1].revents) {
+		// Ready, but the call still would block; let others run before retrying.
+		outOfWork();
+		return 0;
+	}
+
+	for(int i = 0; i < 2; i++) {
+		if(fds[i].revents)
+			continue;
+
+		zth_dbg(io, "[%s] poll(%d) hand-off", currentFiber().str().c_str(), fds[i].fd);
+		AwaitFd w(&fds[i], 1);
+		if(currentWorker().waiter().waitFd(w))
+			return w.error();
+	}
+
+	return 0;
+}
+
+/*!
+ * \brief Like normal \c %sendfile(), but forwards the \c %poll() to the #zth::Waiter in case it would block.
+ * \details When \p out_fd is blocking, it is made non-blocking during this call.
+ *          Note that this flag is shared by all duplicates of the fd.
+ * \ingroup zth_api_cpp_io
+ */
+ssize_t sendfile(int out_fd, int in_fd, off_t* offset, size_t count) {
+	perf_syscall("sendfile()");
+	NonBlocking nb(out_fd);
+
+	while(true) {
+		ssize_t res = ::sendfile(out_fd, in_fd, offset, count);
+		if(res != -1 || errno != EAGAIN)
+			return res;
+
+		zth_dbg(io, "[%s] sendfile(%d) hand-off", currentFiber().str().c_str(), out_fd);
+		if((errno = awaitInOut(in_fd, out_fd)))
+			return -1;
+	}
+}
+
+/*!
+ * \brief Like normal \c %splice(), but forwards the \c %poll() to the #zth::Waiter in case it would block.
+ * \details \c SPLICE_F_NONBLOCK is implied. Blocking fds are made non-blocking during this call,
+ *          like zth::io::sendfile() does.
+ * \ingroup zth_api_cpp_io
+ */
+ssize_t splice(int fd_in, loff_t* off_in, int fd_out, loff_t* off_out, size_t len, unsigned int flags) {
+	perf_syscall("splice()");
+	NonBlocking nb_in(fd_in);
+	NonBlocking nb_out(fd_out);
+
+	while(true) {
+		ssize_t res = ::splice(fd_in, off_in, fd_out, off_out, len, flags | SPLICE_F_NONBLOCK);
+		if(res != -1 || errno != EAGAIN)
+			return res;
+
+		zth_dbg(io, "[%s] splice(%d, %d) hand-off", currentFiber().str().c_str(), fd_in, fd_out);
+		if((errno = awaitInOut(fd_in, fd_out)))
+			return -1;
+	}
+}
+
+/*!
+ * \brief Like normal \c %tee(), but forwards the \c %poll() to the #zth::Waiter in case it would block.
+ * \details \c SPLICE_F_NONBLOCK is implied.
+ * \ingroup zth_api_cpp_io
+ */
+ssize_t tee(int fd_in, int fd_out, size_t len, unsigned int flags) {
+	perf_syscall("tee()");
+
+	while(true) {
+		ssize_t res = ::tee(fd_in, fd_out, len, flags | SPLICE_F_NONBLOCK);
+		if(res != -1 || errno != EAGAIN)
+			return res;
+
+		zth_dbg(io, "[%s] tee(%d, %d) hand-off", currentFiber().str().c_str(), fd_in, fd_out);
+		if((errno = awaitInOut(fd_in, fd_out)))
+			return -1;
+	}
+}
+
+SplicePipe::~SplicePipe() {
+	for(int i = 0; i < 2; i++)
+		if(m_fd[i] != -1)
+			close(m_fd[i]);
+}
+
+/*!
+ * \brief Move at most \p len bytes from \p fd_in to \p fd_out, without copying them to user space.
+ * \return the number of bytes written to \p fd_out, 0 on end-of-file of \p fd_in, or -1 on error with \c errno set
+ */
+ssize_t SplicePipe::transfer(int fd_in, int fd_out, size_t len) {
+	if(m_fd[0] == -1 && pipe2(m_fd, O_NONBLOCK | O_CLOEXEC))
+		return -1;
+
+	if(!m_pending) {
+		ssize_t res = io::splice(fd_in, NULL, m_fd[1], NULL, len, SPLICE_F_MOVE);
+		if(res <= 0)
+			return res;
+		m_pending = (size_t)res;
+	}
+
+	ssize_t done = 0;
+	while(m_pending) {
+		ssize_t res = io::splice(m_fd[0], NULL, fd_out, NULL, m_pending, SPLICE_F_MOVE);
+		if(res == -1)
+			return done ? done : -1;
+		m_pending -= (size_t)res;
+		done += res;
+	}
+
+	return done;
+}
+
+/*!
+ * \brief Like normal \c %recvmmsg(), but forwards the \c %poll() to the #zth::Waiter in case it would block.
+ * \details All datagrams that are available are received, up to \p vlen.
+ *          The fiber only waits when there are none; \c MSG_DONTWAIT is implied.
+ * \ingroup zth_api_cpp_io
+ */
+int recvmmsg(int sockfd, struct mmsghdr* msgvec, unsigned int vlen, int flags) {
+	perf_syscall("recvmmsg()");
+
+	while(true) {
+		int res = ::recvmmsg(sockfd, msgvec, vlen, flags | MSG_DONTWAIT, NULL);
+		if(res != -1 || errno != EAGAIN || (flags & MSG_DONTWAIT))
+			return res;
+
+		zth_dbg(io, "[%s] recvmmsg(%d) hand-off", currentFiber().str().c_str(), sockfd);
+		Await1Fd w(sockfd, POLLIN_SET);
+		if((errno = currentWorker().waiter().waitFd(w)))
+			return -1;
+	}
+}
+
+/*!
+ * \brief Like normal \c %sendmmsg(), but forwards the \c %poll() to the #zth::Waiter in case it would block.
+ * \details The fiber waits till all \p vlen datagrams are sent, unless \c MSG_DONTWAIT is passed.
+ * \return the number of sent datagrams, or -1 on error with \c errno set when none were sent
+ * \ingroup zth_api_cpp_io
+ */
+int sendmmsg(int sockfd, struct mmsghdr* msgvec, unsigned int vlen, int flags) {
+	perf_syscall("sendmmsg()");
+
+	unsigned int done = 0;
+	while(done < vlen) {
+		int res = ::sendmmsg(sockfd, msgvec + done, vlen - done, flags | MSG_DONTWAIT);
+		if(res > 0) {
+			done += (unsigned int)res;
+			continue;
+		}
+
+		if(res == 0 || errno != EAGAIN || (flags & MSG_DONTWAIT))
+			break;
+
+		zth_dbg(io, "[%s] sendmmsg(%d) hand-off", currentFiber().str().c_str(), sockfd);
+		Await1Fd w(sockfd, POLLOUT_SET);
+		if(int error = currentWorker().waiter().waitFd(w)) {
+			errno = error;
+			break;
+		}
+	}
+
+	return done || !vlen ? (int)done : -1;
+}
+
+MessageBatch::MessageBatch(size_t capacity, size_t messageSize)
+	: m_capacity(capacity)
+	, m_messageSize(messageSize)
+	, m_size()
+	, m_sent()
+	, m_buffer(new char[capacity * messageSize])
+	, m_msg(new struct mmsghdr[capacity])
+	, m_iov(new struct iovec[capacity])
+	, m_addr(new struct sockaddr_storage[capacity])
+{
+	for(size_t i = 0; i < capacity; i++) {
+		m_iov[i].iov_base = m_buffer + i * messageSize;
+		m_iov[i].iov_len = messageSize;
+	}
+}
+
+MessageBatch::~MessageBatch() {
+	delete[] m_addr;
+	delete[] m_iov;
+	delete[] m_msg;
+	delete[] m_buffer;
+}
+
+/*!
+ * \brief Receives as many datagrams as available, up to #capacity().
+ * \details The fiber only waits via the zth::Waiter when there are none.
+ *          Previous contents of the batch are discarded.
+ * \return the number of received datagrams, which is also #size(), or -1 on error with \c errno set
+ */
+int MessageBatch::recv(int sockfd, int flags) {
+	clear();
+
+	for(size_t i = 0; i < m_capacity; i++) {
+		struct msghdr& h = m_msg[i].msg_hdr;
+		m_iov[i].iov_len = m_messageSize;
+		h.msg_name = &m_addr[i];
+		h.msg_namelen = sizeof(m_addr[i]);
+		h.msg_iov = &m_iov[i];
+		h.msg_iovlen = 1;
+		h.msg_control = NULL;
+		h.msg_controllen = 0;
+		h.msg_flags = 0;
+		m_msg[i].msg_len = 0;
+	}
+
+	int res = io::recvmmsg(sockfd, m_msg, (unsigned int)m_capacity, flags);
+	if(res > 0)
+		m_size = (size_t)res;
+	return res;
+}
+
+/*!
+ * \brief Copies a datagram into the batch, to be sent by #send().
+ * \param addr the destination, or \c NULL for a connected socket
+ * \return \c false when the batch is full, or \p buf does not fit in #messageSize()
+ */
+bool MessageBatch::add(void const* buf, size_t len, struct sockaddr const* addr, socklen_t addrlen) {
+	if(full() || len > m_messageSize || addrlen > sizeof(m_addr[0]))
+		return false;
+
+	size_t i = m_size++;
+	memcpy(m_iov[i].iov_base, buf, len);
+	m_iov[i].iov_len = len;
+
+	struct msghdr& h = m_msg[i].msg_hdr;
+	if(addr) {
+		memcpy(&m_addr[i], addr, addrlen);
+		h.msg_name = &m_addr[i];
+		h.msg_namelen = addrlen;
+	} else {
+		h.msg_name = NULL;
+		h.msg_namelen = 0;
+	}
+	h.msg_iov = &m_iov[i];
+	h.msg_iovlen = 1;
+	h.msg_control = NULL;
+	h.msg_controllen = 0;
+	h.msg_flags = 0;
+	m_msg[i].msg_len = 0;
+	return true;
+}
+
+/*!
+ * \brief Sends all datagrams that were added, and not sent yet.
+ * \details When all are sent, the batch is cleared. Otherwise, the next call continues with the remaining ones.
+ * \return the number of sent datagrams, or -1 on error with \c errno set when none were sent
+ */
+int MessageBatch::send(int sockfd, int flags) {
+	int res = io::sendmmsg(sockfd, m_msg + m_sent, (unsigned int)(m_size - m_sent), flags);
+	if(res > 0)
+		m_sent += (size_t)res;
+	if(m_sent == m_size)
+		clear();
+	return res;
+}
+#  endif // ZTH_OS_LINUX
+
 } } // namespace
 #else
 static int no_io __attribute__((unused));
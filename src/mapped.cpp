@@ -0,0 +1,174 @@
+/*
+ * Zth (libzth), a cooperative userspace multitasking library.
+ * Copyright (C) 2019  Jochem Rutgers
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define ZTH_REDIRECT_IO 0
+#include <libzth/mapped.h>
+#include <libzth/blocking.h>
+#include <libzth/util.h>
+
+#ifdef ZTH_HAVE_MMAN
+
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace zth { namespace io {
+
+static size_t pageSize() {
+	static size_t page = 0;
+	if(unlikely(!page)) {
+		long res = sysconf(_SC_PAGESIZE);
+		page = res > 0 ? (size_t)res : 0x1000;
+	}
+	return page;
+}
+
+MappedFile::MappedFile()
+	: m_data()
+	, m_size()
+{}
+
+MappedFile::~MappedFile() {
+	close();
+}
+
+/*!
+ * \brief Opens and maps the whole file at \p path.
+ * \return 0 on success, otherwise an \c errno
+ */
+int MappedFile::open(char const* path, bool writable) {
+	int fd = ::open(path, (writable ? O_RDWR : O_RDONLY) | O_CLOEXEC);
+	if(fd == -1)
+		return errno;
+
+	int res = map(fd, 0, 0, writable);
+	::close(fd);
+	return res;
+}
+
+/*!
+ * \brief Maps \p length bytes of \p fd, starting at \p offset.
+ * \details When \p length is 0, the rest of the file is mapped.
+ *          \p offset must be a multiple of the page size. The fd may be closed afterwards.
+ * \return 0 on success, otherwise an \c errno
+ */
+int MappedFile::map(int fd, size_t length, off_t offset, bool writable) {
+	close();
+
+	if(!length) {
+		struct stat st;
+		if(fstat(fd, &st))
+			return errno;
+		if(st.st_size <= offset)
+			return 0;
+		length = (size_t)(st.st_size - offset);
+	}
+
+	void* data = mmap(NULL, length, PROT_READ | (writable ? PROT_WRITE : 0), MAP_SHARED, fd, offset);
+	if(data == MAP_FAILED)
+		return errno;
+
+	m_data = static_cast<char*>(data);
+	m_size = length;
+	return 0;
+}
+
+void MappedFile::close() {
+	if(m_data)
+		munmap(m_data, m_size);
+
+	m_data = NULL;
+	m_size = 0;
+}
+
+/*!
+ * \brief Returns the offset of the first page in the given range that is not in memory, or \p end if there is none.
+ */
+size_t MappedFile::nonResident(size_t offset, size_t end) const {
+	size_t const page = pageSize();
+	unsigned char vec[256];
+
+	offset &= ~(page - 1);
+	while(offset < end) {
+		size_t len = std::min(end - offset, sizeof(vec) * page);
+#ifdef ZTH_OS_MAC
+		if(mincore(m_data + offset, len, (char*)vec))
+#else
+		if(mincore(m_data + offset, len, vec))
+#endif
+			// Don't know, assume the worst.
+			return offset;
+
+		size_t pages = (len + page - 1) / page;
+		for(size_t i = 0; i < pages; i++)
+			if(!(vec[i] & 1))
+				return offset + i * page;
+
+		offset += len;
+	}
+
+	return end;
+}
+
+/*!
+ * \brief Checks if the given range of the mapping is in memory.
+ */
+bool MappedFile::resident(size_t offset, size_t length) const {
+	if(offset >= m_size)
+		return true;
+
+	size_t end = length > m_size - offset ? m_size : offset + length;
+	return nonResident(offset, end) >= end;
+}
+
+static int prefetch_touch(char const* p, size_t length, size_t page) {
+	char const volatile* v = p;
+	for(size_t i = 0; i < length; i += page)
+		(void)v[i];
+	return 0;
+}
+
+/*!
+ * \brief Makes sure that the given range of the mapping is in memory.
+ * \details When it is not, the kernel is asked to read it ahead, and the pages are touched by a
+ *          zth::blocking() helper thread. Only the calling fiber waits for that, until the range is resident.
+ *          The pages may be evicted again later on, under memory pressure.
+ * \return 0 on success, otherwise an \c errno
+ */
+int MappedFile::prefetch(size_t offset, size_t length) {
+	if(offset >= m_size)
+		return 0;
+
+	size_t end = length > m_size - offset ? m_size : offset + length;
+	size_t start = nonResident(offset, end);
+	if(start >= end)
+		// Already in memory.
+		return 0;
+
+	if(madvise(m_data + start, end - start, MADV_WILLNEED))
+		return errno;
+
+	blocking(&prefetch_touch, (char const*)(m_data + start), end - start, pageSize());
+	return 0;
+}
+
+} } // namespace
+#endif // ZTH_HAVE_MMAN
@@ -0,0 +1,263 @@
+/*
+ * Zth (libzth), a cooperative userspace multitasking library.
+ * Copyright (C) 2019  Jochem Rutgers
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define ZTH_REDIRECT_IO 0
+#include <libzth/process.h>
+#include <libzth/worker.h>
+
+#if !defined(ZTH_OS_WINDOWS) && !defined(ZTH_OS_BAREMETAL)
+
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#ifdef ZTH_OS_LINUX
+#  include <sys/syscall.h>
+#endif
+
+extern char** environ;
+
+namespace zth {
+
+Process::Process()
+	: m_pid()
+	, m_pidfd(-1)
+	, m_exited()
+	, m_status()
+{
+	m_fd[Stdin] = m_fd[Stdout] = m_fd[Stderr] = -1;
+}
+
+Process::~Process() {
+	close(Stdin);
+	close(Stdout);
+	close(Stderr);
+
+	if(m_pidfd != -1)
+		::close(m_pidfd);
+
+	if(running())
+		sigchld_reap(m_pid);
+}
+
+/*!
+ * \brief Closes the parent's end of the pipe of the given stream.
+ * \details Close #Stdin to signal end-of-file to the process.
+ */
+void Process::close(Stream stream) {
+	if(m_fd[stream] != -1) {
+		::close(m_fd[stream]);
+		m_fd[stream] = -1;
+	}
+}
+
+/*!
+ * \brief Starts a process, like \c posix_spawnp().
+ * \details When a previous process was awaited by #wait(), the pipes to it are closed first.
+ * \param file the program, which is searched for in \c PATH
+ * \param argv the \c NULL terminated argument list
+ * \param pipes the streams to connect to a pipe (\c PipeStdin, \c PipeStdout, \c PipeStderr);
+ *              the other streams are inherited
+ * \param envp the environment, or \c NULL to inherit it
+ * \return 0 on success, \c EBUSY when the previous process was not awaited yet, otherwise an \c errno
+ */
+int Process::spawn(char const* file, char* const argv[], int pipes, char* const envp[]) {
+	if(running())
+		return EBUSY;
+
+	perf_syscall("spawn()");
+
+	close(Stdin);
+	close(Stdout);
+	close(Stderr);
+
+	posix_spawn_file_actions_t actions;
+	int res = posix_spawn_file_actions_init(&actions);
+	if(res)
+		return res;
+
+	int child[3] = {-1, -1, -1};
+	for(int i = Stdin; !res && i <= Stderr; i++) {
+		if(!(pipes & (1 << i)))
+			continue;
+
+		int p[2];
+#ifdef ZTH_OS_LINUX
+		if(pipe2(p, O_CLOEXEC)) {
+			res = errno;
+			break;
+		}
+#else
+		if(pipe(p)) {
+			res = errno;
+			break;
+		}
+		fcntl(p[0], F_SETFD, FD_CLOEXEC);
+		fcntl(p[1], F_SETFD, FD_CLOEXEC);
+#endif
+
+		// The child reads from stdin, and writes to the others.
+		child[i] = i == Stdin ? p[0] : p[1];
+		m_fd[i] = i == Stdin ? p[1] : p[0];
+		fcntl(m_fd[i], F_SETFL, fcntl(m_fd[i], F_GETFL) | O_NONBLOCK);
+
+		res = posix_spawn_file_actions_adddup2(&actions, child[i], i);
+	}
+
+	if(!res)
+		res = posix_spawnp(&m_pid, file, &actions, NULL, argv, envp ? envp : environ);
+
+	posix_spawn_file_actions_destroy(&actions);
+	for(int i = Stdin; i <= Stderr; i++)
+		if(child[i] != -1)
+			::close(child[i]);
+
+	if(res) {
+		zth_dbg(worker, "[%s] Could not spawn %s; %s", currentFiber().id_str(), file, err(res).c_str());
+		m_pid = 0;
+		close(Stdin);
+		close(Stdout);
+		close(Stderr);
+		return res;
+	}
+
+	m_exited = false;
+	m_status = 0;
+#ifdef SYS_pidfd_open
+	// Fails on kernels before 5.3; wait() polls in that case.
+	m_pidfd = (int)syscall(SYS_pidfd_open, m_pid, 0);
+#endif
+
+	zth_dbg(worker, "[%s] Spawned %s as process %u", currentFiber().id_str(), file, (unsigned int)m_pid);
+	return 0;
+}
+
+/*!
+ * \brief Reads from the pipe of #Stdout or #Stderr, while other fibers continue.
+ * \return the number of bytes read, 0 on end-of-file, or -1 on error with \c errno set
+ */
+ssize_t Process::read_(Stream stream, void* buf, size_t count) {
+	int fd = m_fd[stream];
+	if(fd == -1 || stream == Stdin) {
+		errno = EBADF;
+		return -1;
+	}
+
+	while(true) {
+		ssize_t res = ::read(fd, buf, count);
+		if(res != -1 || errno != EAGAIN)
+			return res;
+
+		Await1Fd w(fd, POLLIN);
+		if(int error = currentWorker().waiter().waitFd(w)) {
+			errno = error;
+			return -1;
+		}
+	}
+}
+
+/*!
+ * \brief Writes all data to the pipe of #Stdin, while other fibers continue.
+ * \return \p count, or -1 on error with \c errno set
+ */
+ssize_t Process::write(void const* buf, size_t count) {
+	int fd = m_fd[Stdin];
+	if(fd == -1) {
+		errno = EBADF;
+		return -1;
+	}
+
+	size_t done = 0;
+	while(done < count) {
+		ssize_t res = ::write(fd, (char const*)buf + done, count - done);
+		if(res >= 0) {
+			done += (size_t)res;
+			continue;
+		}
+		if(errno != EAGAIN)
+			return -1;
+
+		Await1Fd w(fd, POLLOUT);
+		if(int error = currentWorker().waiter().waitFd(w)) {
+			errno = error;
+			return -1;
+		}
+	}
+
+	return (ssize_t)done;
+}
+
+/*!
+ * \brief Sends a signal to the process.
+ * \return 0 on success, otherwise an \c errno
+ */
+int Process::kill(int sig) {
+	if(!running())
+		return ESRCH;
+
+	return ::kill(m_pid, sig) ? errno : 0;
+}
+
+/*!
+ * \brief Waits till the process terminates, while other fibers continue.
+ * \param status when not \c NULL, receives the status, as returned by \c waitpid()
+ * \return 0 on success, otherwise an \c errno
+ */
+int Process::wait(int* status) {
+	if(m_pid <= 0)
+		return ECHILD;
+
+	if(!m_exited)
+		perf_syscall("Process::wait()");
+
+	while(!m_exited) {
+		int wstatus = 0;
+		pid_t res = waitpid(m_pid, &wstatus, WNOHANG);
+
+		if(res == m_pid) {
+			zth_dbg(worker, "[%s] Process %u terminated with exit code %d",
+				currentFiber().id_str(), (unsigned int)m_pid, wstatus);
+			m_exited = true;
+			m_status = wstatus;
+
+			// The pid may be reused from now on.
+			if(m_pidfd != -1) {
+				::close(m_pidfd);
+				m_pidfd = -1;
+			}
+		} else if(res == -1) {
+			if(errno != EINTR)
+				return errno;
+		} else if(m_pidfd != -1) {
+			Await1Fd w(m_pidfd, POLLIN);
+			if(int error = currentWorker().waiter().waitFd(w))
+				return error;
+		} else {
+			mnap(10);
+		}
+	}
+
+	if(status)
+		*status = m_status;
+	return 0;
+}
+
+} // namespace
+#else
+static int no_process __attribute__((unused));
+#endif // !ZTH_OS_WINDOWS && !ZTH_OS_BAREMETAL
@@ -0,0 +1,462 @@
+/*
+ * Zth (libzth), a cooperative userspace multitasking library.
+ * Copyright (C) 2019  Jochem Rutgers
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define ZTH_REDIRECT_IO 0
+#include <libzth/shm.h>
+#include <libzth/util.h>
+#include <libzth/worker.h>
+
+#if defined(ZTH_HAVE_EVENTFD) && defined(ZTH_HAVE_MMAN)
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace zth {
+
+/*!
+ * \brief The start of the shared memory segment, followed by the ring.
+ * \details The fields that are written by the writer and by the reader are in separate cache lines.
+ */
+struct ShmChannel::Header {
+	uint32_t magic;
+	uint32_t shutdown;
+	uint64_t size;
+	char pad0[48];
+
+	// Written by the writer.
+	uint64_t head;
+	uint32_t writerWaiting;
+	char pad1[52];
+
+	// Written by the reader.
+	uint64_t tail;
+	uint32_t readerWaiting;
+	char pad2[52];
+};
+
+static uint32_t const ShmMagic = 0x5a746853; // "ZthS"
+// The length of a record that tells the reader to continue at the start of the ring.
+static uint32_t const ShmWrap = 0xffffffffu;
+
+static size_t shmRecord(size_t length) {
+	// Records are 8-byte aligned, such that a wrap marker always fits at the end of the ring.
+	return (sizeof(uint32_t) + length + 7u) & ~(size_t)7u;
+}
+
+static void shmSignal(int fd) {
+	uint64_t one = 1;
+	ssize_t res = ::write(fd, &one, sizeof(one));
+	(void)res;
+}
+
+ShmChannel::ShmChannel()
+	: m_header()
+	, m_ring()
+	, m_size()
+	, m_shmFd(-1)
+	, m_dataFd(-1)
+	, m_spaceFd(-1)
+	, m_pending()
+{}
+
+ShmChannel::~ShmChannel() {
+	reset();
+}
+
+/*!
+ * \brief Unmaps the segment and closes all fds.
+ */
+void ShmChannel::reset() {
+	if(m_header)
+		munmap(m_header, sizeof(Header) + m_size);
+	m_header = NULL;
+	m_ring = NULL;
+	m_size = 0;
+	m_pending = 0;
+
+	if(m_shmFd != -1)
+		close(m_shmFd);
+	if(m_dataFd != -1)
+		close(m_dataFd);
+	if(m_spaceFd != -1)
+		close(m_spaceFd);
+	m_shmFd = m_dataFd = m_spaceFd = -1;
+}
+
+/*!
+ * \brief Creates a new channel, with a ring of at least \p size bytes.
+ * \return 0 on success, otherwise an \c errno
+ */
+int ShmChannel::create(size_t size) {
+	if(m_shmFd != -1)
+		return EALREADY;
+
+	size_t ring = 0x1000;
+	while(ring < size)
+		ring <<= 1;
+
+#ifdef SYS_memfd_create
+	m_shmFd = (int)syscall(SYS_memfd_create, "zth::ShmChannel", 1u /* MFD_CLOEXEC */);
+#else
+	std::string name = format("/zth-shm-%d-%p", (int)getpid(), this);
+	if((m_shmFd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600)) != -1)
+		shm_unlink(name.c_str());
+#endif
+	int res = 0;
+	if(m_shmFd == -1)
+		return errno;
+
+	if(ftruncate(m_shmFd, (off_t)(sizeof(Header) + ring))) {
+		res = errno;
+		goto error;
+	}
+
+	if((m_dataFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1
+		|| (m_spaceFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1)
+	{
+		res = errno;
+		goto error;
+	}
+
+	if((res = map(false)))
+		goto error;
+
+	// A new segment is zero-initialized.
+	m_header->size = ring;
+	__atomic_store_n(&m_header->magic, ShmMagic, __ATOMIC_RELEASE);
+	return 0;
+
+error:
+	// Allow a retry.
+	reset();
+	return res;
+}
+
+/*!
+ * \brief Attaches to a channel, which was created by another process.
+ * \details On success, the ownership of the fds is passed to this object.
+ *          On failure, the fds are left to the caller.
+ * \return 0 on success, \c EINVAL when \p shmFd is not a completely created channel, otherwise an \c errno
+ */
+int ShmChannel::attach(int shmFd, int dataFd, int spaceFd) {
+	if(m_shmFd != -1)
+		return EALREADY;
+
+	for(int i = 0; i < 2; i++) {
+		int fd = i ? spaceFd : dataFd;
+		int flags = fcntl(fd, F_GETFL);
+		if(flags == -1 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1)
+			return errno;
+	}
+
+	m_shmFd = shmFd;
+	if(int res = map(true)) {
+		m_shmFd = -1;
+		return res;
+	}
+
+	m_dataFd = dataFd;
+	m_spaceFd = spaceFd;
+	return 0;
+}
+
+/*!
+ * \brief Maps the segment of #m_shmFd.
+ * \param attach when \c true, require that the segment was completely initialized by #create()
+ */
+int ShmChannel::map(bool attach) {
+	struct stat st;
+	if(fstat(m_shmFd, &st))
+		return errno;
+
+	size_t length = (size_t)st.st_size;
+	if(length < sizeof(Header) + 0x1000)
+		return EINVAL;
+
+	void* p = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, m_shmFd, 0);
+	if(p == MAP_FAILED)
+		return errno;
+
+	Header* header = static_cast<Header*>(p);
+	// create() writes the magic last, so the size is valid once the magic is there.
+	if(attach && (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != ShmMagic
+		|| header->size != length - sizeof(Header)))
+	{
+		munmap(p, length);
+		return EINVAL;
+	}
+
+	m_header = header;
+	m_ring = static_cast<char*>(p) + sizeof(Header);
+	m_size = length - sizeof(Header);
+	return 0;
+}
+
+/*!
+ * \brief Returns the fds to be passed to #attach() of the other process.
+ */
+void ShmChannel::fds(int& shmFd, int& dataFd, int& spaceFd) const {
+	shmFd = m_shmFd;
+	dataFd = m_dataFd;
+	spaceFd = m_spaceFd;
+}
+
+/*!
+ * \brief Closes the channel for both sides.
+ * \details The writer cannot send anymore, and the reader gets \c EPIPE once the ring is empty.
+ */
+void ShmChannel::shutdown() {
+	if(!m_header)
+		return;
+
+	__atomic_store_n(&m_header->shutdown, 1, __ATOMIC_SEQ_CST);
+	shmSignal(m_dataFd);
+	shmSignal(m_spaceFd);
+}
+
+bool ShmChannel::isShutdown() const {
+	return !m_header || __atomic_load_n(&m_header->shutdown, __ATOMIC_ACQUIRE);
+}
+
+/*!
+ * \brief Returns the maximum length of one message.
+ */
+size_t ShmChannel::maxMessage() const {
+	return m_header ? m_size / 2u - sizeof(uint32_t) : 0;
+}
+
+/*!
+ * \brief Waits for a #ring() of \p fd by the other side.
+ * \details The caller has to set its waiting flag and check its condition again, before calling this function.
+ */
+int ShmChannel::waitFor(int fd) {
+	Worker* w = Worker::currentWorker();
+	if(unlikely(!w))
+		return EAGAIN;
+
+	Await1Fd a(fd, POLLIN);
+	if(int res = w->waiter().waitFd(a))
+		return res;
+
+	// Reset the eventfd.
+	uint64_t count;
+	ssize_t res = ::read(fd, &count, sizeof(count));
+	(void)res;
+	return 0;
+}
+
+/*!
+ * \brief Signals \p fd, when the other side set \p waiting.
+ */
+void ShmChannel::ring(int fd, uint32_t* waiting) {
+	if(__atomic_exchange_n(waiting, 0, __ATOMIC_SEQ_CST))
+		shmSignal(fd);
+}
+
+/*!
+ * \brief Reserves space for a message of \p length bytes in the ring, and waits for it when the ring is full.
+ * \details Fill the returned buffer, and pass it to the reader by #commit().
+ * \return the buffer, or \c NULL on error with \c errno set, which is \c EPROTO when the reader corrupted the ring
+ */
+void* ShmChannel::reserve(size_t length) {
+	if(!m_header) {
+		errno = ENOTCONN;
+		return NULL;
+	}
+
+	if(length > maxMessage()) {
+		errno = EMSGSIZE;
+		return NULL;
+	}
+
+	size_t const size = m_size;
+	size_t const record = shmRecord(length);
+	bool armed = false;
+
+	while(true) {
+		if(__atomic_load_n(&m_header->shutdown, __ATOMIC_ACQUIRE)) {
+			errno = EPIPE;
+			return NULL;
+		}
+
+		uint64_t head = m_header->head;
+		uint64_t tail = __atomic_load_n(&m_header->tail, __ATOMIC_SEQ_CST);
+		if(unlikely(head - tail > size || (head & 7u))) {
+			// The reader corrupted the ring.
+			errno = EPROTO;
+			return NULL;
+		}
+
+		size_t offset = (size_t)head & (size - 1u);
+		size_t contiguous = size - offset;
+		size_t needed = record <= contiguous ? record : contiguous + record;
+
+		if(size - (size_t)(head - tail) >= needed) {
+			if(record > contiguous) {
+				*reinterpret_cast<uint32_t*>(m_ring + offset) = ShmWrap;
+				offset = 0;
+			}
+
+			*reinterpret_cast<uint32_t*>(m_ring + offset) = (uint32_t)length;
+			m_pending = needed;
+			return m_ring + offset + sizeof(uint32_t);
+		}
+
+		if(!armed) {
+			// Check again after announcing that we are going to wait.
+			__atomic_store_n(&m_header->writerWaiting, 1, __ATOMIC_SEQ_CST);
+			armed = true;
+		} else if(int res = waitFor(m_spaceFd)) {
+			errno = res;
+			return NULL;
+		} else {
+			armed = false;
+		}
+	}
+}
+
+/*!
+ * \brief Passes the message of the last #reserve() to the reader.
+ */
+void ShmChannel::commit() {
+	if(!m_pending)
+		return;
+
+	__atomic_store_n(&m_header->head, m_header->head + m_pending, __ATOMIC_SEQ_CST);
+	m_pending = 0;
+	ring(m_dataFd, &m_header->readerWaiting);
+}
+
+/*!
+ * \brief Returns the next message in the ring, and waits for it when the ring is empty.
+ * \details The message stays in the ring until #release().
+ * \return the message, or \c NULL on error with \c errno set, which is \c EPROTO when the writer corrupted the ring
+ */
+void const* ShmChannel::peek(size_t& length) {
+	if(!m_header) {
+		errno = ENOTCONN;
+		return NULL;
+	}
+
+	size_t const size = m_size;
+	bool armed = false;
+
+	while(true) {
+		uint64_t tail = m_header->tail;
+		uint64_t head = __atomic_load_n(&m_header->head, __ATOMIC_SEQ_CST);
+
+		if(head != tail) {
+			// Don't trust the writer; the record must be within the committed part of the ring.
+			if(unlikely(head - tail > size || (tail & 7u))) {
+				errno = EPROTO;
+				return NULL;
+			}
+
+			size_t offset = (size_t)tail & (size - 1u);
+			size_t skip = 0;
+			uint32_t len = *reinterpret_cast<uint32_t const*>(m_ring + offset);
+			if(len == ShmWrap) {
+				skip = size - offset;
+				offset = 0;
+				len = *reinterpret_cast<uint32_t const*>(m_ring);
+			}
+
+			if(unlikely((size_t)len > maxMessage() || skip + shmRecord((size_t)len) > (size_t)(head - tail))) {
+				errno = EPROTO;
+				return NULL;
+			}
+
+			length = (size_t)len;
+			m_pending = skip + shmRecord(length);
+			return m_ring + offset + sizeof(uint32_t);
+		}
+
+		if(__atomic_load_n(&m_header->shutdown, __ATOMIC_ACQUIRE)) {
+			errno = EPIPE;
+			return NULL;
+		}
+
+		if(!armed) {
+			// Check again after announcing that we are going to wait.
+			__atomic_store_n(&m_header->readerWaiting, 1, __ATOMIC_SEQ_CST);
+			armed = true;
+		} else if(int res = waitFor(m_dataFd)) {
+			errno = res;
+			return NULL;
+		} else {
+			armed = false;
+		}
+	}
+}
+
+/*!
+ * \brief Removes the message of the last #peek() from the ring.
+ */
+void ShmChannel::release() {
+	if(!m_pending)
+		return;
+
+	__atomic_store_n(&m_header->tail, m_header->tail + m_pending, __ATOMIC_SEQ_CST);
+	m_pending = 0;
+	ring(m_spaceFd, &m_header->writerWaiting);
+}
+
+/*!
+ * \brief Copies a message into the ring.
+ * \return \p length, or -1 on error with \c errno set
+ */
+ssize_t ShmChannel::send(void const* buf, size_t length) {
+	void* p = reserve(length);
+	if(!p)
+		return -1;
+
+	memcpy(p, buf, length);
+	commit();
+	return (ssize_t)length;
+}
+
+/*!
+ * \brief Copies the next message from the ring.
+ * \return the length of the message, or -1 on error with \c errno set;
+ *         when the message does not fit in \p buf, \c errno is \c EMSGSIZE and the message stays in the ring
+ */
+ssize_t ShmChannel::recv(void* buf, size_t length) {
+	size_t len = 0;
+	void const* p = peek(len);
+	if(!p)
+		return -1;
+
+	if(len > length) {
+		m_pending = 0;
+		errno = EMSGSIZE;
+		return -1;
+	}
+
+	memcpy(buf, p, len);
+	release();
+	return (ssize_t)len;
+}
+
+} // namespace
+#endif // ZTH_HAVE_EVENTFD && ZTH_HAVE_MMAN
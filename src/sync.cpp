@@ -0,0 +1,117 @@
+/*
+ * Zth (libzth), a cooperative userspace multitasking library.
+ * Copyright (C) 2019  Jochem Rutgers
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <libzth/macros.h>
+#include <libzth/sync.h>
+#include <libzth/worker.h>
+
+namespace zth {
+
+namespace impl {
+	/*!
+	 * \brief Removes an AddressWait from its bucket when its deadline has passed.
+	 */
+	class AddressAlarm : public TimedWaitable {
+	public:
+		AddressAlarm(List<AddressWait>& bucket, AddressWait& wait, Timestamp const& deadline)
+			: TimedWaitable(deadline), m_bucket(bucket), m_wait(wait)
+		{
+			setFiber(wait.fiber);
+			wait.alarm = this;
+		}
+		virtual ~AddressAlarm() {}
+
+		virtual bool poll(Timestamp const& now = Timestamp::now()) {
+			if(!TimedWaitable::poll(now))
+				return false;
+
+			zth_dbg(sync, "[%p] Timeout of %s", m_wait.addr, m_wait.fiber.id_str());
+			m_bucket.erase(m_wait);
+			m_wait.alarm = NULL;
+			m_wait.timedOut = true;
+			// The Waiter wakes up the fiber.
+			return true;
+		}
+
+	private:
+		List<AddressWait>& m_bucket;
+		AddressWait& m_wait;
+	};
+
+	int waitOnAddress(void const volatile* addr, Timestamp const& deadline) {
+		bool timed = !deadline.isNull();
+		if(timed && deadline <= Timestamp::now())
+			return ETIMEDOUT;
+
+		Worker* w;
+		Fiber* f;
+		getContext(&w, &f);
+
+		List<AddressWait>& bucket = w->addressTable().bucket(addr);
+		AddressWait wait(addr, *f);
+
+		zth_dbg(sync, "[%p] Block %s", addr, f->id_str());
+		w->release(*f);
+		bucket.push_back(wait);
+		f->nap(Timestamp::null());
+
+		if(timed) {
+			AddressAlarm alarm(bucket, wait, deadline);
+			w->waiter().scheduleTask(alarm);
+			w->schedule();
+			if(wait.alarm)
+				w->waiter().unscheduleTask(alarm);
+		} else {
+			w->schedule();
+		}
+
+		return wait.timedOut ? ETIMEDOUT : 0;
+	}
+} // namespace impl
+
+size_t wakeAddress(void const volatile* addr, size_t n) {
+	Worker* w = Worker::currentWorker();
+	if(unlikely(!w))
+		return 0;
+
+	List<impl::AddressWait>& bucket = w->addressTable().bucket(addr);
+	size_t woken = 0;
+
+	for(List<impl::AddressWait>::iterator it = bucket.begin(); woken < n && it != bucket.end();) {
+		impl::AddressWait& wait = *it;
+		if(wait.addr != addr) {
+			++it;
+			continue;
+		}
+
+		it = bucket.erase(it);
+		if(wait.alarm) {
+			w->waiter().unscheduleTask(*wait.alarm);
+			wait.alarm = NULL;
+		}
+
+		zth_dbg(sync, "[%p] Unblock %s", addr, wait.fiber.id_str());
+		wait.fiber.wakeup();
+		w->add(&wait.fiber);
+		woken++;
+	}
+
+	return woken;
+}
+
+} // namespace
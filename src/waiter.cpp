@@ -16,12 +16,93 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#define ZTH_REDIRECT_IO 0
 #include <libzth/waiter.h>
 #include <libzth/worker.h>
 #include <libzth/io.h>
 
+#include <cmath>
+
+#ifdef ZTH_HAVE_EPOLL
+#  include <sys/epoll.h>
+#endif
+#ifdef ZTH_HAVE_SIGNALFD
+#  include <sys/signalfd.h>
+#endif
+#ifdef ZTH_HAVE_PTHREAD
+#  include <pthread.h>
+#endif
+
+#ifdef ZTH_HAVE_EVENTFD
+#  include <sys/eventfd.h>
+#elif defined(ZTH_HAVE_POLLER) && !defined(ZTH_OS_WINDOWS)
+#  include <fcntl.h>
+#endif
+
 namespace zth {
 
+/*!
+ * \brief Returns the time to stop sleeping, in order to busy-wait the last part till \p t.
+ * \see zth::Config::TimerSpin_s()
+ */
+static Timestamp sleepDeadline(Timestamp const& t) {
+	if(Config::TimerSpin_s() > 0)
+		return t - TimeInterval(Config::TimerSpin_s());
+	else
+		return t;
+}
+
+/*!
+ * \brief Busy-wait till \p t, which finishes what #sleepDeadline() left.
+ */
+static void spinUntil(Timestamp const& t) {
+	if(Config::TimerSpin_s() > 0)
+		while(Timestamp::now() < t);
+}
+
+Waiter::Waiter(Worker& worker)
+	: m_worker(worker)
+	, m_notified()
+#ifdef ZTH_HAVE_SIGNALFD
+	, m_signalFd(-1)
+	, m_signalWaiters()
+#endif
+#ifdef ZTH_HAVE_EPOLL
+	, m_pollFd(-1)
+	, m_pollFdComplete(true)
+#endif
+{
+	m_notifyFd[0] = m_notifyFd[1] = -1;
+
+#ifdef ZTH_HAVE_EVENTFD
+	if((m_notifyFd[0] = m_notifyFd[1] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1)
+		zth_abort("Cannot create eventfd; %s", err(errno).c_str());
+#elif defined(ZTH_HAVE_POLLER) && !defined(ZTH_OS_WINDOWS)
+	if(pipe(m_notifyFd))
+		zth_abort("Cannot create notification pipe; %s", err(errno).c_str());
+
+	for(int i = 0; i < 2; i++) {
+		fcntl(m_notifyFd[i], F_SETFL, fcntl(m_notifyFd[i], F_GETFL) | O_NONBLOCK);
+		fcntl(m_notifyFd[i], F_SETFD, FD_CLOEXEC);
+	}
+#endif
+}
+
+Waiter::~Waiter() {
+	if(m_notifyFd[1] != -1 && m_notifyFd[1] != m_notifyFd[0])
+		close(m_notifyFd[1]);
+	if(m_notifyFd[0] != -1)
+		close(m_notifyFd[0]);
+#ifdef ZTH_HAVE_SIGNALFD
+	if(m_signalFd != -1)
+		close(m_signalFd);
+#endif
+#ifdef ZTH_HAVE_EPOLL
+	if(m_pollFd != -1)
+		close(m_pollFd);
+#endif
+}
+
 void waitUntil(TimedWaitable& w) {
 	perf_syscall("waitUntil()");
 	currentWorker().waiter().wait(w);
@@ -64,8 +145,237 @@ void Waiter::unscheduleTask(TimedWaitable& w) {
 		m_waiting.erase(w);
 }
 
+/*!
+ * \brief Wake up the Waiter, and all fibers that are blocked in #waitNotify().
+ * \details This function is thread-safe and async-signal-safe.
+ */
+void Waiter::notify() {
+	if(__atomic_exchange_n(&m_notified, 1, __ATOMIC_ACQ_REL))
+		// Already pending.
+		return;
+
+	if(m_notifyFd[1] == -1)
+		return;
+
+	int errno_ = errno;
+#ifdef ZTH_HAVE_EVENTFD
+	uint64_t one = 1;
+#else
+	char one = 1;
+#endif
+	// Ignore errors; when the pipe is full, there is a wakeup pending anyway.
+	ssize_t res = ::write(m_notifyFd[1], &one, sizeof(one));
+	(void)res;
+	errno = errno_;
+}
+
+/*!
+ * \brief Block the current fiber till the next #notify().
+ * \details When \p word is given, the fiber is only woken up by a #notify() after \p *word differs from \p value,
+ *          such that only the fibers of which the condition changed are woken up.
+ *          Therefore, change \p *word before calling #notify().
+ *          Spurious wakeups are possible, so check the actual condition in a loop.
+ */
+void Waiter::waitNotify(int const* word, int value) {
+	Fiber* fiber = m_worker.currentFiber();
+	if(unlikely(!fiber || fiber->state() != Fiber::Running))
+		return;
+
+	if(word && __atomic_load_n(word, __ATOMIC_SEQ_CST) != value)
+		return;
+
+	impl::NotifyWait w(*fiber, word, value);
+	fiber->nap();
+	m_worker.release(*fiber);
+	m_notifyList.push_back(w);
+
+	if(this->fiber())
+		m_worker.resume(*this->fiber());
+
+	m_worker.schedule();
+}
+
+/*!
+ * \brief Drains the notify fd, and wakes up the fibers in #waitNotify() of which the condition changed.
+ */
+void Waiter::handleNotify() {
+	if(m_notifyFd[0] != -1) {
+		char buf[64];
+		while(::read(m_notifyFd[0], buf, sizeof(buf)) == (ssize_t)sizeof(buf));
+	}
+
+	// Reset after draining, such that the next notify() writes again, and the fd is never empty while
+	// m_notified is set. A notify() in between is covered by the fibers below, which check their condition.
+	// The exchange synchronizes with the one in notify(), such that the changed words are visible below.
+	__atomic_exchange_n(&m_notified, 0, __ATOMIC_SEQ_CST);
+
+	for(List<impl::NotifyWait>::iterator it = m_notifyList.begin(); it != m_notifyList.end();) {
+		impl::NotifyWait& w = *it;
+		if(w.word && __atomic_load_n(w.word, __ATOMIC_SEQ_CST) == w.value) {
+			++it;
+			continue;
+		}
+
+		it = m_notifyList.erase(it);
+		zth_dbg(waiter, "[%s] %s got notified; wakeup", id_str(), w.fiber.id_str());
+		w.fiber.wakeup();
+		m_worker.add(&w.fiber);
+	}
+}
+
+/*!
+ * \brief Handle a pending #notify(), if any.
+ */
+void Waiter::checkNotify() {
+	if(unlikely(__atomic_load_n(&m_notified, __ATOMIC_ACQUIRE)))
+		handleNotify();
+}
+
+#ifdef ZTH_HAVE_SIGNALFD
+/*!
+ * \brief Wait for one of the signals in \p set, while other fibers continue.
+ * \details The signals are blocked for the calling thread, such that they are not delivered otherwise.
+ *          As signals may be delivered to any thread, block them in all other threads as well,
+ *          preferably before starting these.
+ * \param set the signals to wait for
+ * \param info when not \c NULL, receives the details of the signal
+ * \return the signal number, or -1 on error with \c errno set
+ * \ingroup zth_api_cpp_fiber
+ */
+int waitSignal(sigset_t const& set, siginfo_t* info) {
+	perf_syscall("waitSignal()");
+	return currentWorker().waiter().waitSignal(set, info);
+}
+
+/*!
+ * \copydoc waitSignal(sigset_t const&, siginfo_t*)
+ * \ingroup zth_api_cpp_fiber
+ */
+int waitSignal(int sig, siginfo_t* info) {
+	sigset_t set;
+	sigemptyset(&set);
+	sigaddset(&set, sig);
+	return waitSignal(set, info);
+}
+
+int Waiter::waitSignal(sigset_t const& set, siginfo_t* info) {
+	Fiber* fiber = m_worker.currentFiber();
+	if(unlikely(!fiber || fiber->state() != Fiber::Running)) {
+		errno = EAGAIN;
+		return -1;
+	}
+
+#  ifdef ZTH_HAVE_PTHREAD
+	if((errno = pthread_sigmask(SIG_BLOCK, &set, NULL)))
+		return -1;
+#  else
+	if(sigprocmask(SIG_BLOCK, &set, NULL))
+		return -1;
+#  endif
+
+	// Maybe it is pending already.
+	struct timespec const zero = {};
+	int sig = sigtimedwait(&set, info, &zero);
+	if(sig != -1 || (errno != EAGAIN && errno != EINTR))
+		return sig;
+
+	for(int s = 1; s < NSIG; s++)
+		if(sigismember(&set, s) == 1)
+			m_signalWaiters[s]++;
+
+	int error = updateSignalFd();
+
+	while(!error) {
+		zth_dbg(waiter, "[%s] %s waits for a signal", id_str(), fiber->id_str());
+		Await1Fd w(m_signalFd, POLLIN);
+		if((error = waitFd(w)))
+			break;
+
+		// The signalfd is shared by all fibers that wait for a signal, so only take one from our set.
+		if((sig = sigtimedwait(&set, info, &zero)) != -1)
+			break;
+		if(errno != EAGAIN && errno != EINTR)
+			error = errno;
+	}
+
+	for(int s = 1; s < NSIG; s++)
+		if(sigismember(&set, s) == 1)
+			m_signalWaiters[s]--;
+
+	// Stop polling signals that nobody waits for anymore.
+	updateSignalFd();
+
+	if(error) {
+		errno = error;
+		return -1;
+	}
+
+	return sig;
+}
+
+/*!
+ * \brief Set the mask of the signalfd to the signals that fibers are waiting for.
+ * \return 0 on success, otherwise an \c errno
+ */
+int Waiter::updateSignalFd() {
+	sigset_t mask;
+	sigemptyset(&mask);
+	for(int s = 1; s < NSIG; s++)
+		if(m_signalWaiters[s])
+			sigaddset(&mask, s);
+
+	int fd = signalfd(m_signalFd, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+	if(fd == -1)
+		return errno;
+
+	m_signalFd = fd;
+	return 0;
+}
+#endif
+
 
 #ifdef ZTH_HAVE_POLLER
+/*!
+ * \brief Do a \c poll() on the given fds, which times out at the given absolute time.
+ * \param deadline when \c NULL, block indefinitely; when it has passed already, do not block at all
+ * \param error set to the error code, when -1 is returned
+ * \return the number of fds that have events, 0 on timeout, or -1 on error
+ */
+static int pollUntil(std::vector<zth_pollfd_t>& fds, Timestamp const* deadline, int& error) {
+#  ifdef ZTH_HAVE_LIBZMQ
+	long timeout_ms = -1;
+	if(deadline) {
+		TimeInterval dt = *deadline - Timestamp::now();
+		// Round up. Otherwise, we wake up too early and keep polling with a timeout of 0 till the deadline.
+		timeout_ms = dt.hasPassed() ? 0L : (long)std::ceil(dt.s() * 1000.0);
+	}
+
+	int res = ::zmq_poll(&fds[0], (int)fds.size(), timeout_ms);
+	error = res == -1 ? zmq_errno() : 0;
+#  elif defined(ZTH_HAVE_PPOLL)
+	struct timespec timeout = {};
+	if(deadline) {
+		TimeInterval dt = *deadline - Timestamp::now();
+		if(!dt.hasPassed())
+			timeout = dt.ts();
+	}
+
+	int res = ::ppoll(&fds[0], (nfds_t)fds.size(), deadline ? &timeout : NULL, NULL);
+	error = res == -1 ? errno : 0;
+#  else
+	int timeout_ms = -1;
+	if(deadline) {
+		TimeInterval dt = *deadline - Timestamp::now();
+		// Round up. Otherwise, we wake up too early and keep polling with a timeout of 0 till the deadline.
+		timeout_ms = dt.hasPassed() ? 0 : (int)std::ceil(dt.s() * 1000.0);
+	}
+
+	int res = ::poll(&fds[0], (nfds_t)fds.size(), timeout_ms);
+	error = res == -1 ? errno : 0;
+#  endif
+	return res;
+}
+
 void Waiter::checkFdList() {
 	if(!Config::EnableAssert && (!zth_config(EnableDebugPrint) || !Config::Print_list))
 		return;
@@ -90,7 +400,33 @@ void Waiter::checkFdList() {
 	zth_assert(offset == m_fdPollList.size());
 }
 
+/*!
+ * \brief Waits for the fds of \p w, or its timeout.
+ * \return 0 on success, otherwise an errno; the number of ready fds is in AwaitFd::result()
+ */
 int Waiter::waitFd(AwaitFd& w) {
+	int res = addFd(w);
+	if(res)
+		return res;
+
+	// Put ourselves to sleep.
+	Fiber& fiber = w.fiber();
+	fiber.nap();
+	m_worker.release(fiber);
+	m_worker.schedule();
+
+	// Got back, check which fds were triggered.
+	zth_assert(w.finished());
+	return removeFd(w);
+}
+
+/*!
+ * \brief Adds the fds of \p w to the set of fds that are polled for the current fiber.
+ * \details The fiber is woken up when an fd gets ready or the timeout passes, but it should
+ *          put itself to sleep first. Call #removeFd() afterwards, also when it was woken up otherwise.
+ * \return 0 on success, otherwise an errno
+ */
+int Waiter::addFd(AwaitFd& w) {
 	Fiber* fiber = m_worker.currentFiber();
 	if(unlikely(!fiber || fiber->state() != Fiber::Running))
 		return EAGAIN;
@@ -105,22 +441,21 @@ int Waiter::waitFd(AwaitFd& w) {
 	
 	checkFdList();
 
-	// Put ourselves to sleep.
-	fiber->nap();
-	m_worker.release(*fiber);
-
-	// Switch to Waiter
+	// Make sure the Waiter runs to poll them.
 	if(this->fiber())
 		m_worker.resume(*this->fiber());
-	
-	m_worker.schedule();
 
-	// Got back, check which fds were triggered.
-	zth_assert(w.finished());
+	return 0;
+}
 
+/*!
+ * \brief Removes the fds of \p w, which were added by #addFd(), and copies their \c revents.
+ * \return 0 on success, otherwise an errno; the number of ready fds is in AwaitFd::result()
+ */
+int Waiter::removeFd(AwaitFd& w) {
 	size_t offset = 0;
 	int res = 0;
-	for(decltype(m_fdList.begin()) itw = m_fdList.begin(); itw != m_fdList.end(); ++itw, offset += itw->nfds())
+	for(decltype(m_fdList.begin()) itw = m_fdList.begin(); itw != m_fdList.end(); offset += itw->nfds(), ++itw)
 		if(&*itw == &w) {
 			// This is us
 			if(!w.error()) {
@@ -148,132 +483,336 @@ int Waiter::waitFd(AwaitFd& w) {
 }
 #endif
 
-void Waiter::entry() {
-	zth_assert(&currentWorker() == &m_worker);
-	fiber()->setName(format("zth::Waiter of %s", m_worker.id_str()));
+/*!
+ * \brief Checks if there is nothing to wait for.
+ */
+bool Waiter::idle() const {
+	return m_waiting.empty() && m_notifyList.empty()
+#ifdef ZTH_HAVE_POLLER
+		&& m_fdPollList.empty()
+#endif
+		;
+}
 
-	while(true) {
-		Timestamp now = Timestamp::now();
-
-		while(!m_waiting.empty() && m_waiting.front().timeout() < now) {
-			TimedWaitable& w = m_waiting.front();
-			m_waiting.erase(w);
-			if(w.poll(now)) {
-				if(w.hasFiber()) {
-					w.fiber().wakeup();
-					m_worker.add(&w.fiber());
-				}
-			} else {
-				// Reinsert, as the timeout() might have changed (and therefore the position in the list).
-				m_waiting.insert(w);
+/*!
+ * \brief Wakes up all fibers of which the timer has expired, and runs the scheduled tasks.
+ */
+void Waiter::checkTimers(Timestamp const& now) {
+	while(!m_waiting.empty() && m_waiting.front().timeout() < now) {
+		TimedWaitable& w = m_waiting.front();
+		m_waiting.erase(w);
+		if(w.poll(now)) {
+			if(w.hasFiber()) {
+				w.fiber().wakeup();
+				m_worker.add(&w.fiber());
 			}
+		} else {
+			// Reinsert, as the timeout() might have changed (and therefore the position in the list).
+			m_waiting.insert(w);
 		}
+	}
+}
 
-		bool doRealSleep = false;
+/*!
+ * \brief Checks the fds and notifications, and wakes up the fibers that are waiting for them.
+ * \param block when \c true, there is nothing else to do; sleep till the first timer expires, or an fd gets ready
+ */
+void Waiter::pollEvents(bool block) {
+	bool doRealSleep = block;
+	zth_assert(!doRealSleep || !idle());
 
-		if(m_waiting.empty()
 #ifdef ZTH_HAVE_POLLER
-			&& m_fdPollList.empty()
-#endif
-		) {
-			// No fiber is waiting. suspend() till anyone is going to nap().
-			zth_dbg(waiter, "[%s] No sleeping fibers anymore; suspend", id_str());
-			m_worker.suspend(*fiber());
-		} else if(!m_worker.schedule()) {
-			// When true, we were not rescheduled, which means that we are the only runnable fiber.
-			// Do a real sleep, until something interesting happens in the system.
-			doRealSleep = true;
+	// When blocking, notify() should be able to wake us up.
+	bool pollNotify = doRealSleep && m_notifyFd[0] != -1;
+
+	if(!m_fdPollList.empty() || pollNotify) {
+		Timestamp const* pollTimeout = NULL;
+		if(doRealSleep) {
+			if(!m_worker.runEnd().isNull() && (!pollTimeout || *pollTimeout > m_worker.runEnd()))
+				pollTimeout = &m_worker.runEnd();
+			for(decltype(m_fdList.begin()) it = m_fdList.begin(); it != m_fdList.end(); ++it)
+				if(!it->timeout().isNull() && (!pollTimeout || *pollTimeout > it->timeout()))
+					pollTimeout = &it->timeout();
+			if(!m_waiting.empty() && (!pollTimeout || *pollTimeout > m_waiting.front().timeout()))
+				pollTimeout = &m_waiting.front().timeout();
 		}
 
-#ifdef ZTH_HAVE_POLLER
-		if(!m_fdPollList.empty()) {
-			Timestamp const* pollTimeout = NULL;
-			if(doRealSleep) {
-				if(!m_worker.runEnd().isNull() && (!pollTimeout || *pollTimeout > m_worker.runEnd()))
-					pollTimeout = &m_worker.runEnd();
-				for(decltype(m_fdList.begin()) it = m_fdList.begin(); it != m_fdList.end(); ++it)
-					if(!it->timeout().isNull() && (!pollTimeout || *pollTimeout > it->timeout()))
-						pollTimeout = &it->timeout();
-				if(!m_waiting.empty() && (!pollTimeout || *pollTimeout > m_waiting.front().timeout()))
-					pollTimeout = &m_waiting.front().timeout();
+		// By default, don't block.
+		Timestamp deadline = Timestamp::null();
+		if(doRealSleep) {
+			if(!pollTimeout) {
+				zth_dbg(waiter, "[%s] Out of other work than doing poll()", id_str());
+			} else {
+				zth_dbg(waiter, "[%s] Out of other work than doing poll(); timeout is %s", id_str(),
+					(*pollTimeout - Timestamp::now()).str().c_str());
+				deadline = sleepDeadline(*pollTimeout);
 			}
+		}
 
-			int timeout_ms = 0;
-			if(doRealSleep) {
-				if(!pollTimeout) {
-					// Infinite sleep.
-					timeout_ms = -1;
-					zth_dbg(waiter, "[%s] Out of other work than doing poll()", id_str());
-				} else {
-					TimeInterval dt = *pollTimeout - Timestamp::now();
-					zth_dbg(waiter, "[%s] Out of other work than doing poll(); timeout is %s", id_str(), dt.str().c_str());
-					timeout_ms = std::max<int>(0, (int)(dt.s() * 1000.0));
-				}
-			}
+		// Without our own fiber, we are called from the Worker's context, which has no perf administration.
+		if(doRealSleep && fiber()) {
+			perf_mark("blocking poll()");
+			perf_event(PerfEvent<>(*fiber(), Fiber::Waiting));
+		}
 
-			if(doRealSleep) {
-				perf_mark("blocking poll()");
-				perf_event(PerfEvent<>(*fiber(), Fiber::Waiting));
-			}
+		if(pollNotify) {
+			zth_pollfd_t p = zth_pollfd_t();
+			p.fd = m_notifyFd[0];
+			p.events = POLLIN;
+			m_fdPollList.push_back(p);
+		}
 
-#ifdef ZTH_HAVE_LIBZMQ
-			int res = ::zmq_poll(&m_fdPollList[0], (int)m_fdPollList.size(), timeout_ms);
-			int error = res == -1 ? zmq_errno() : 0;
-#else
-			int res = ::poll(&m_fdPollList[0], (nfds_t)m_fdPollList.size(), timeout_ms);
-			int error = res == -1 ? errno : 0;
-#endif
-			
-			if(doRealSleep) {
-				perf_event(PerfEvent<>(*fiber(), fiber()->state()));
-				perf_mark("wakeup");
+		if(pollNotify && __atomic_load_n(&m_notified, __ATOMIC_ACQUIRE)) {
+			// A notify() is pending already; don't block on its fd, as it may have been drained.
+			deadline = Timestamp::null();
+			pollTimeout = &deadline;
+		}
+
+		int error = 0;
+		// Passing NULL results in an infinite sleep.
+		int res = pollUntil(m_fdPollList, doRealSleep && !pollTimeout ? NULL : &deadline, error);
+
+		if(pollNotify) {
+			if(res > 0 && m_fdPollList.back().revents) {
+				res--;
+				handleNotify();
 			}
+			m_fdPollList.pop_back();
+		}
 
-			if(res == -1) {
-				zth_dbg(waiter, "[%s] poll() failed; %s", id_str(), err(error).c_str());
-				for(decltype(m_fdList.begin()) it = m_fdList.begin(); it != m_fdList.end(); ++it) {
-					zth_dbg(waiter, "[%s] %s got error; wakeup", id_str(), it->str().c_str());
-					it->setResult(-1, error);
-					it->fiber().wakeup();
-					m_worker.add(&it->fiber());
-				}
-			} else if(res > 0) {
-				size_t offset = 0;
-				for(decltype(m_fdList.begin()) it = m_fdList.begin(); res > 0 && it != m_fdList.end(); offset += it->nfds(), ++it) {
-					bool wakeup = false;
-					zth_assert(m_fdPollList.size() >= offset + it->nfds());
-					for(size_t i = 0; res > 0 && i < (size_t)it->nfds(); i++) {
-						if(m_fdPollList[offset + i].revents) {
-							wakeup = true;
-							res--;
-						}
-					}
+		if(doRealSleep && res == 0 && pollTimeout)
+			spinUntil(*pollTimeout);
+		
+		if(doRealSleep && fiber()) {
+			perf_event(PerfEvent<>(*fiber(), fiber()->state()));
+			perf_mark("wakeup");
+		}
 
-					if(wakeup) {
-						zth_dbg(waiter, "[%s] %s got ready; wakeup", id_str(), it->str().c_str());
-						it->setResult(0);
-						it->fiber().wakeup();
-						m_worker.add(&it->fiber());
+		if(res == -1) {
+			zth_dbg(waiter, "[%s] poll() failed; %s", id_str(), err(error).c_str());
+			for(decltype(m_fdList.begin()) it = m_fdList.begin(); it != m_fdList.end(); ++it) {
+				if(it->finished())
+					continue;
+				zth_dbg(waiter, "[%s] %s got error; wakeup", id_str(), it->str().c_str());
+				it->setResult(-1, error);
+				it->fiber().wakeup();
+				m_worker.add(&it->fiber());
+			}
+		} else {
+			Timestamp now = Timestamp::now();
+			size_t offset = 0;
+			for(decltype(m_fdList.begin()) it = m_fdList.begin(); it != m_fdList.end(); offset += it->nfds(), ++it) {
+				if(it->finished())
+					// Already woken up, but did not run yet.
+					continue;
+
+				bool wakeup = false;
+				zth_assert(m_fdPollList.size() >= offset + it->nfds());
+				for(size_t i = 0; res > 0 && i < (size_t)it->nfds(); i++) {
+					if(m_fdPollList[offset + i].revents) {
+						wakeup = true;
+						res--;
 					}
 				}
+
+				if(wakeup) {
+					zth_dbg(waiter, "[%s] %s got ready; wakeup", id_str(), it->str().c_str());
+				} else if(!it->timeout().isNull() && it->timeout() <= now) {
+					zth_dbg(waiter, "[%s] %s timed out; wakeup", id_str(), it->str().c_str());
+				} else
+					continue;
+
+				it->setResult(0);
+				it->fiber().wakeup();
+				m_worker.add(&it->fiber());
 			}
-		} else
+		}
+	} else
 #endif
-		if(doRealSleep) {
-			zth_dbg(waiter, "[%s] Out of work; suspend thread, while waiting for %s", id_str(), m_waiting.front().str().c_str());
-			Timestamp const* end = &m_waiting.front().timeout();
-			if(!m_worker.runEnd().isNull () && *end > m_worker.runEnd())
-				end = &m_worker.runEnd();
+	if(doRealSleep && !__atomic_load_n(&m_notified, __ATOMIC_ACQUIRE)) {
+		// Without an fd to poll, notify() cannot interrupt the sleep; limit it when a fiber is waiting for it.
+		Timestamp end = m_waiting.empty() || !m_notifyList.empty()
+			? Timestamp::now() + TimeInterval(Config::MinTimeslice_s()) : m_waiting.front().timeout();
+		if(!m_waiting.empty() && end > m_waiting.front().timeout())
+			end = m_waiting.front().timeout();
+		if(!m_worker.runEnd().isNull () && end > m_worker.runEnd())
+			end = m_worker.runEnd();
+		zth_dbg(waiter, "[%s] Out of work; suspend thread for %s", id_str(), (end - Timestamp::now()).str().c_str());
+		if(fiber()) {
 			perf_mark("idle system; sleep");
 			perf_event(PerfEvent<>(*fiber(), Fiber::Waiting));
-			clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &end->ts(), NULL);
+		}
+		Timestamp wakeup = sleepDeadline(end);
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wakeup.ts(), NULL);
+		spinUntil(end);
+		if(fiber()) {
 			perf_event(PerfEvent<>(*fiber(), fiber()->state()));
 			perf_mark("wakeup");
 		}
+	}
+
+	checkNotify();
+}
 
+/*!
+ * \brief Checks timers, notifications and (at most once per #zth::Config::MinTimeslice_s()) the fds, without blocking.
+ * \details This is called by the Worker on every schedule(), when #zth::Config::EnableWaiterFiber is \c false.
+ */
+void Waiter::tick(Timestamp const& now) {
+	checkTimers(now);
+	checkNotify();
+
+#ifdef ZTH_HAVE_POLLER
+	if(!m_fdPollList.empty() && !now.isBefore(m_nextPoll)) {
+		pollEvents(false);
+		m_nextPoll = now + TimeInterval(Config::MinTimeslice_s());
+	}
+#endif
+}
+
+/*!
+ * \brief Returns an fd that gets readable when the Worker has something to do.
+ * \details That is, when #notify() was called, or when an fd that a fiber waits for got ready.
+ *          On Linux, this is an epoll fd, which is updated by #updatePollFd().
+ *          Otherwise, only notifications are reported, and #nextDeadline() limits the sleep when fds are awaited.
+ * \return the fd, or -1 when there is none
+ */
+int Waiter::pollFd() {
+#ifdef ZTH_HAVE_EPOLL
+	if(m_pollFd == -1) {
+		if((m_pollFd = epoll_create1(EPOLL_CLOEXEC)) == -1)
+			return -1;
+
+		struct epoll_event ev = {};
+		ev.events = EPOLLIN;
+		ev.data.fd = m_notifyFd[0];
+		if(epoll_ctl(m_pollFd, EPOLL_CTL_ADD, m_notifyFd[0], &ev)) {
+			close(m_pollFd);
+			return m_pollFd = -1;
+		}
+
+		updatePollFd();
+	}
+
+	return m_pollFd;
+#else
+	return m_notifyFd[0];
+#endif
+}
+
+/*!
+ * \brief Registers the fds that fibers currently wait for to the #pollFd().
+ */
+void Waiter::updatePollFd() {
+#ifdef ZTH_HAVE_EPOLL
+	if(m_pollFd == -1)
+		return;
+
+	std::map<int,short> events;
+	bool complete = true;
+	for(size_t i = 0; i < m_fdPollList.size(); i++) {
+#  ifdef ZTH_HAVE_LIBZMQ
+		if(m_fdPollList[i].socket) {
+			complete = false;
+			continue;
+		}
+#  endif
+		events[m_fdPollList[i].fd] |= m_fdPollList[i].events;
+	}
+
+	for(std::map<int,short>::iterator it = m_pollFdEvents.begin(); it != m_pollFdEvents.end(); ++it)
+		if(!events.count(it->first))
+			// Fails when the fd was closed in the meantime, which is fine.
+			epoll_ctl(m_pollFd, EPOLL_CTL_DEL, it->first, NULL);
+
+	for(std::map<int,short>::iterator it = events.begin(); it != events.end();) {
+		std::map<int,short>::iterator registered = m_pollFdEvents.find(it->first);
+		if(registered != m_pollFdEvents.end() && registered->second == it->second) {
+			++it;
+			continue;
+		}
+
+		struct epoll_event ev = {};
+		ev.events = impl::toEpoll(it->second);
+		ev.data.fd = it->first;
+		if(registered != m_pollFdEvents.end() && !epoll_ctl(m_pollFd, EPOLL_CTL_MOD, it->first, &ev)) {
+			++it;
+		} else if(!epoll_ctl(m_pollFd, EPOLL_CTL_ADD, it->first, &ev) || errno == EEXIST) {
+			++it;
+		} else {
+			// Regular files cannot be registered, for example.
+			complete = false;
+			events.erase(it++);
+		}
+	}
+
+	m_pollFdEvents.swap(events);
+	m_pollFdComplete = complete;
+#endif
+}
+
+/*!
+ * \brief Returns when the Waiter should be run at the latest, or a null Timestamp when it only has to for #pollFd().
+ */
+Timestamp Waiter::nextDeadline() const {
+	if(__atomic_load_n(&m_notified, __ATOMIC_ACQUIRE))
+		return Timestamp::now();
+
+	Timestamp deadline = Timestamp::null();
+	if(!m_waiting.empty())
+		deadline = m_waiting.front().timeout();
+
+#ifdef ZTH_HAVE_POLLER
+	for(decltype(m_fdList.begin()) it = m_fdList.begin(); it != m_fdList.end(); ++it)
+		if(!it->timeout().isNull() && (deadline.isNull() || deadline > it->timeout()))
+			deadline = it->timeout();
+
+	bool polled = !m_fdPollList.empty();
+#  ifdef ZTH_HAVE_EPOLL
+	polled = polled && (m_pollFd == -1 || !m_pollFdComplete);
+#  endif
+	if(polled) {
+		// Not all fds can be waited for via pollFd(); poll them every time slice.
+		Timestamp t = Timestamp::now() + TimeInterval(Config::MinTimeslice_s());
+		if(deadline.isNull() || deadline > t)
+			deadline = t;
+	}
+#endif
+
+	return deadline;
+}
+
+void Waiter::entry() {
+	zth_assert(&currentWorker() == &m_worker);
+	fiber()->setName(format("zth::Waiter of %s", m_worker.id_str()));
+
+	while(true) {
+		checkTimers();
+
+		bool doRealSleep = false;
+
+		if(idle()) {
+			// No fiber is waiting. suspend() till anyone is going to nap().
+			zth_dbg(waiter, "[%s] No sleeping fibers anymore; suspend", id_str());
+			m_worker.suspend(*fiber());
+		} else if(!m_worker.schedule()) {
+			// When true, we were not rescheduled, which means that we are the only runnable fiber.
+			if(m_worker.runningOnce()) {
+				// Don't block the thread, but return to Worker::runOnce() when there is nothing left to do.
+				pollEvents(false);
+				sigchld_check();
+				if(!m_worker.schedule())
+					m_worker.suspend(*fiber());
+				continue;
+			}
+
+			// Do a real sleep, until something interesting happens in the system.
+			doRealSleep = true;
+		}
+
+		pollEvents(doRealSleep);
 		sigchld_check();
 	}
 }
 
 } // namespace
-
@@ -45,7 +45,7 @@ void worker_global_init() {
 }
 ZTH_INIT_CALL(worker_global_init)
 	
-#ifdef ZTH_USE_PTHREAD
+#ifdef ZTH_HAVE_PTHREAD
 static void* worker_main(void* fiber) {
 	Worker w;
 	w << (Fiber*)fiber;
@@ -58,7 +58,7 @@ static void* worker_main(void* fiber) {
  * \ingroup zth_api_cpp_fiber
  */
 int startWorkerThread(UNUSED_PAR(void(*f)()), size_t UNUSED_PAR(stack), char const* UNUSED_PAR(name)) {
-#ifdef ZTH_USE_PTHREAD
+#ifdef ZTH_HAVE_PTHREAD
 	pthread_t t;
 	int res = 0;
 
@@ -126,7 +126,7 @@ int execvp(char const* UNUSED_PAR(file), char* const UNUSED_PAR(arg[])) {
 	pid_t pid;
 	if((pid = vfork()) == 0) {
 		// In child.
-		execvp(file, arg);
+		::execvp(file, arg);
 		// If we get here, we could not create the process.
 		_exit(127);
 	} else if(pid == -1) {
@@ -134,6 +134,8 @@ int execvp(char const* UNUSED_PAR(file), char* const UNUSED_PAR(arg[])) {
 		Worker* w = Worker::currentWorker();
 		char const* id_str = w ? w->id_str() : "?";
 		zth_dbg(worker, "[%s] Could not vfork(); %s", id_str, err(res).c_str());
+	} else {
+		sigchld_reap(pid);
 	}
 	return res;
 #endif
@@ -141,12 +143,35 @@ int execvp(char const* UNUSED_PAR(file), char* const UNUSED_PAR(arg[])) {
 
 #if !defined(ZTH_OS_WINDOWS) && !defined(ZTH_OS_BAREMETAL)
 static volatile sig_atomic_t sigchld_cleanup = 0;
+// Children that nobody waits for. Others are left alone, such that their owner gets the exit status.
+static std::vector<pid_t> sigchld_children;
+#  ifdef ZTH_HAVE_PTHREAD
+static pthread_mutex_t sigchld_lock = PTHREAD_MUTEX_INITIALIZER;
+#  endif
 
 static void sigchld_handler(int) {
 	sigchld_cleanup = 1;
 }
 #endif
 
+/*!
+ * \brief Let #sigchld_check() reap the given child process when it terminates.
+ */
+void sigchld_reap(UNUSED_PAR(pid_t pid)) {
+#if !defined(ZTH_OS_WINDOWS) && !defined(ZTH_OS_BAREMETAL)
+#  ifdef ZTH_HAVE_PTHREAD
+	pthread_mutex_lock(&sigchld_lock);
+#  endif
+	sigchld_children.push_back(pid);
+#  ifdef ZTH_HAVE_PTHREAD
+	pthread_mutex_unlock(&sigchld_lock);
+#  endif
+
+	// It may have terminated already.
+	sigchld_cleanup = 1;
+#endif
+}
+
 void sigchld_check() {
 #if !defined(ZTH_OS_WINDOWS) && !defined(ZTH_OS_BAREMETAL)
 	if(likely(sigchld_cleanup == 0))
@@ -155,21 +180,31 @@ void sigchld_check() {
 	Worker* w = Worker::currentWorker();
 	char const* id_str = w ? w->id_str() : "?";
 
-	while(true) {
-		sigchld_cleanup = 0;
+	sigchld_cleanup = 0;
+
+#  ifdef ZTH_HAVE_PTHREAD
+	pthread_mutex_lock(&sigchld_lock);
+#  endif
+	for(size_t i = 0; i < sigchld_children.size();) {
 		int wstatus;
-		pid_t pid = waitpid(-1, &wstatus, WNOHANG);
+		pid_t pid = waitpid(sigchld_children[i], &wstatus, WNOHANG);
 
 		if(pid == 0) {
-			// No (other) child exited.
-			return;
+			// Still running.
+			i++;
+			continue;
 		} else if(pid == -1) {
 			zth_dbg(worker, "[%s] waitpid() failed; %s", id_str, err(errno).c_str());
-			return;
 		} else {
 			zth_dbg(worker, "[%s] Child process %u terminated with exit code %d", id_str, (unsigned int)pid, wstatus);
-		} 
+		}
+
+		sigchld_children[i] = sigchld_children.back();
+		sigchld_children.pop_back();
 	}
+#  ifdef ZTH_HAVE_PTHREAD
+	pthread_mutex_unlock(&sigchld_lock);
+#  endif
 #endif
 }
 